@@ -0,0 +1,354 @@
+#include "chip8.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Translates a ROM to C++ ahead of time. Code is found by following the program from PC_START_ADDRESS
+// (jumps, calls, returns and both ways of every skip), each found instruction becomes a case of one big switch
+// on PC. Straight-line code falls through from case to case, jumps and skips are gotos, so nothing is decoded at runtime.
+// Arithmetic, jumps, calls and timers are done on the registers directly, everything touching the screen, keypad,
+// memory or random numbers goes through chip8::interpretCompiled. BNNN, returns and unknown addresses jump back
+// to the switch, addresses it doesn't have are left to the interpreter (see chip8::emulateOneFrame).
+// Stack overflow and underflow are interpreted too, so the core raises the fault - translated code returns after any fault.
+namespace {
+    string hex(uint32_t value, int digits = 3) {
+        ostringstream out;
+        out << "0x" << uppercase << std::hex << setfill('0') << setw(digits) << value;
+        return out.str();
+    }
+
+    string reg(int index) {
+        return "r.regsVx[" + hex(index, 1) + "]";
+    }
+
+    // same set of instructions as the handler maps of chip8
+    bool knownInstruction(uint16_t instruction) {
+        switch (instruction & 0xF000) {
+        case 0x0000:
+            if ((instruction & 0xFFF0) == 0x00C0 || (instruction & 0xFFF0) == 0x00D0) return true;
+            return instruction == 0x00E0 || instruction == 0x00EE || (instruction >= 0x00FB && instruction <= 0x00FF);
+        case 0x5000: {
+            uint16_t low = instruction & 0x000F;
+            return low == 0x0 || low == 0x2 || low == 0x3;
+        }
+        case 0x8000: {
+            uint16_t low = instruction & 0x000F;
+            return low <= 0x7 || low == 0xE;
+        }
+        case 0x9000: return (instruction & 0x000F) == 0;
+        case 0xE000: return (instruction & 0x00FF) == 0x9E || (instruction & 0x00FF) == 0xA1;
+        case 0xF000:
+            switch (instruction & 0x00FF) {
+            case 0x00: case 0x01: case 0x02: case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E:
+            case 0x29: case 0x30: case 0x33: case 0x3A: case 0x55: case 0x65: case 0x75: case 0x85:
+                return true;
+            }
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    // code of one instruction and the addresses it may continue at
+    struct translation {
+        string code;
+        vector<uint32_t> next;
+    };
+
+    class translator {
+    private:
+        vector<uint8_t> rom;
+        uint32_t memorySize;
+        bool longInstructions;
+
+        vector<bool> reached;       // instructions found so far
+        vector<bool> labeled;       // targets of gotos
+        vector<bool> codeBytes;     // bytes the translation depends on
+
+        bool inROM(uint32_t address, uint32_t length) const {
+            return address >= PC_START_ADDRESS && address + length <= PC_START_ADDRESS + rom.size();
+        }
+        uint16_t word(uint32_t address) const {
+            return static_cast<uint16_t>((rom[address - PC_START_ADDRESS] << 8) | rom[address - PC_START_ADDRESS + 1]);
+        }
+
+        // goto when the target is translated, otherwise the interpreter continues there
+        string jumpTo(uint32_t target) {
+            target &= 0xFFFF;
+            if (target < memorySize && reached[target]) {
+                labeled[target] = true;
+                return "goto a_" + hex(target).substr(2) + ";";
+            }
+            return "{ r.regPC = " + hex(target) + "; goto dispatch; }";
+        }
+
+        // address after a skip - XO-CHIP skips F000 NNNN as a whole (it has to be in the ROM to know that)
+        bool skipTarget(uint32_t address, uint32_t& target) {
+            target = address + 2 * INSTRUCTION_BYTES;
+            if (!longInstructions || address + 3 >= memorySize) return true;
+            if (!inROM(address + INSTRUCTION_BYTES, INSTRUCTION_BYTES)) return false;
+
+            codeBytes[address + 2] = codeBytes[address + 3] = true;
+            if (word(address + INSTRUCTION_BYTES) == static_cast<uint16_t>(0xF000)) target += INSTRUCTION_BYTES;
+            return true;
+        }
+
+        translation interpreted(uint32_t address, uint16_t instruction) {
+            uint32_t next = address + INSTRUCTION_BYTES;
+            translation t;
+            t.code = "{ r.regPC = " + hex(address) + "; bool intact = core.interpretCompiled(r); ++n; if (!intact) return n; ";
+
+            if (!knownInstruction(instruction) || instruction == 0x00FD) {
+                t.code += "goto dispatch; }";        // faults / stays where it is
+                return t;
+            }
+
+            t.code += "if (r.regPC != " + hex(next & 0xFFFF) + ") goto dispatch; } " + jumpTo(next);
+            t.next.push_back(next);
+
+            // key skips are interpreted, but the skipped-to address is still code
+            uint32_t target;
+            if ((instruction & 0xF000) == 0xE000 && skipTarget(address, target)) t.next.push_back(target);
+            return t;
+        }
+
+        translation skip(uint32_t address, uint16_t instruction, const string& condition) {
+            uint32_t target;
+            if (!skipTarget(address, target)) return interpreted(address, instruction);
+
+            uint32_t next = address + INSTRUCTION_BYTES;
+            translation t;
+            t.code = "++n; if (" + condition + ") " + jumpTo(target) + " " + jumpTo(next);
+            t.next = { next, target };
+            return t;
+        }
+
+        translation translate(uint32_t address) {
+            uint16_t instruction = word(address);
+            int x = (instruction & 0x0F00) >> 8;
+            int y = (instruction & 0x00F0) >> 4;
+            uint16_t nn = instruction & 0x00FF;
+            uint16_t nnn = instruction & 0x0FFF;
+            uint32_t next = address + INSTRUCTION_BYTES;
+
+            // straight-line instruction
+            auto simple = [&](const string& code) {
+                return translation{ code + " ++n; " + jumpTo(next), { next } };
+            };
+
+            switch (instruction & 0xF000) {
+            case 0x0000:
+                if (instruction == 0x00EE) {
+                    return { "if (r.regSP == 0) { r.regPC = " + hex(address) + "; core.interpretCompiled(r); return n + 1; } "
+                        "--r.regSP; r.regPC = r.stack[r.regSP] + 2; ++n; goto dispatch;", {} };
+                }
+                break;
+            case 0x1000:
+                return { "++n; " + jumpTo(nnn), { nnn } };
+            case 0x2000:
+                return { "if (r.regSP == STACK_SIZE) { r.regPC = " + hex(address) + "; core.interpretCompiled(r); return n + 1; } "
+                    "r.stack[r.regSP++] = " + hex(address) + "; ++n; " + jumpTo(nnn), { nnn, next } };
+            case 0x3000:
+                return skip(address, instruction, reg(x) + " == " + hex(nn, 2));
+            case 0x4000:
+                return skip(address, instruction, reg(x) + " != " + hex(nn, 2));
+            case 0x5000:
+                if ((instruction & 0x000F) == 0) return skip(address, instruction, reg(x) + " == " + reg(y));
+                break;
+            case 0x6000:
+                return simple(reg(x) + " = " + hex(nn, 2) + ";");
+            case 0x7000:
+                return simple(reg(x) + " += " + hex(nn, 2) + ";");
+            case 0x8000:
+                switch (instruction & 0x000F) {
+                case 0x0: return simple(reg(x) + " = " + reg(y) + ";");
+                case 0x1: return simple(reg(x) + " |= " + reg(y) + "; r.regsVx[0xF] = 0;");
+                case 0x2: return simple(reg(x) + " &= " + reg(y) + "; r.regsVx[0xF] = 0;");
+                case 0x3: return simple(reg(x) + " ^= " + reg(y) + "; r.regsVx[0xF] = 0;");
+                case 0x4: return simple("{ uint8_t old = " + reg(x) + "; " + reg(x) + " += " + reg(y) + "; r.regsVx[0xF] = old > " + reg(x) + "; }");
+                case 0x5: return simple("{ bool flag = " + reg(x) + " >= " + reg(y) + "; " + reg(x) + " -= " + reg(y) + "; r.regsVx[0xF] = flag; }");
+                case 0x6: return simple("{ uint8_t flag = " + reg(y) + " & 1; " + reg(x) + " = " + reg(y) + " >> 1; r.regsVx[0xF] = flag; }");
+                case 0x7: return simple("{ bool flag = " + reg(y) + " >= " + reg(x) + "; " + reg(x) + " = " + reg(y) + " - " + reg(x) + "; r.regsVx[0xF] = flag; }");
+                case 0xE: return simple("{ uint8_t flag = " + reg(y) + " >> 7; " + reg(x) + " = " + reg(y) + " << 1; r.regsVx[0xF] = flag; }");
+                }
+                break;
+            case 0x9000:
+                if ((instruction & 0x000F) == 0) return skip(address, instruction, reg(x) + " != " + reg(y));
+                break;
+            case 0xA000:
+                return simple("r.regI = " + hex(nnn) + ";");
+            case 0xB000:
+                return { "r.regPC = " + hex(nnn) + " + r.regsVx[0x0]; ++n; goto dispatch;", {} };     // target is only known at runtime
+            case 0xF000:
+                switch (instruction & 0x00FF) {
+                case 0x00:
+                    // F000 NNNN - the address is a constant too
+                    if (!inROM(address, 2 * INSTRUCTION_BYTES)) break;
+                    codeBytes[address + 2] = codeBytes[address + 3] = true;
+                    return { "r.regI = " + hex(word(next), 4) + "; ++n; " + jumpTo(next + INSTRUCTION_BYTES), { next + INSTRUCTION_BYTES } };
+                case 0x07: return simple(reg(x) + " = r.regDT;");
+                case 0x15: return simple("r.regDT = " + reg(x) + ";");
+                case 0x1E: return simple("r.regI += " + reg(x) + ";");
+                }
+                break;
+            }
+            return interpreted(address, instruction);
+        }
+
+    public:
+        translator(vector<uint8_t> rom, bool longInstructions)
+            : rom(std::move(rom)), memorySize(longInstructions ? MEMORY_SIZE : CHIP8_MEMORY_SIZE), longInstructions(longInstructions)
+            , reached(memorySize), labeled(memorySize), codeBytes(memorySize)
+        {}
+
+        // follows the program from PC_START_ADDRESS (code outside of the ROM is left to the interpreter)
+        void findCode() {
+            vector<uint32_t> pending = { PC_START_ADDRESS };
+            while (!pending.empty()) {
+                uint32_t address = pending.back();
+                pending.pop_back();
+                if (address >= memorySize || reached[address] || !inROM(address, INSTRUCTION_BYTES)) continue;
+
+                reached[address] = true;
+                for (uint32_t next : translate(address).next) pending.push_back(next & 0xFFFF);
+            }
+        }
+
+        void write(ostream& out, const string& name) {
+            // code first, labels are known afterwards
+            vector<pair<uint32_t, string>> cases;
+            for (uint32_t address = 0; address < memorySize; ++address) {
+                if (!reached[address]) continue;
+                codeBytes[address] = codeBytes[address + 1] = true;
+                cases.push_back({ address, translate(address).code });
+            }
+
+            // the next case follows anyway
+            for (size_t i = 0; i + 1 < cases.size(); ++i) {
+                string& code = cases[i].second;
+                string fallthrough = " goto a_" + hex(cases[i + 1].first).substr(2) + ";";
+                if (code.size() >= fallthrough.size() && code.compare(code.size() - fallthrough.size(), fallthrough.size(), fallthrough) == 0) {
+                    code.resize(code.size() - fallthrough.size());
+                    code += " [[fallthrough]];";
+                }
+            }
+
+            // only labels some goto still uses (unused ones are warnings in the emulator build)
+            fill(labeled.begin(), labeled.end(), false);
+            for (const pair<uint32_t, string>& translated : cases) {
+                const string& code = translated.second;
+                for (size_t at = code.find("goto a_"); at != string::npos; at = code.find("goto a_", at + 1)) {
+                    labeled[stoul(code.substr(at + 7), nullptr, 16)] = true;
+                }
+            }
+
+            out << "// generated by ch8aot from " << name << " - don't edit, run ch8aot again instead" << endl;
+            out << "#include \"chip8.hpp\"" << endl;
+            out << "#include \"compiled.hpp\"" << endl << endl;
+            out << "#include <iterator>" << endl << endl;
+            out << "namespace {" << endl;
+
+            out << "\tconst uint8_t rom[] = {";
+            for (size_t i = 0; i < rom.size(); ++i) out << ((i % 16 == 0) ? "\n\t\t" : " ") << hex(rom[i], 2) << ",";
+            out << "\n\t};" << endl << endl;
+
+            out << "\tconst uint16_t codeRanges[][2] = {" << endl;
+            for (uint32_t address = 0; address < memorySize; ) {
+                if (!codeBytes[address]) {
+                    ++address;
+                    continue;
+                }
+                uint32_t last = address;
+                while (last + 1 < memorySize && codeBytes[last + 1]) ++last;
+                out << "\t\t{ " << hex(address) << ", " << hex(last) << " }," << endl;
+                address = last + 1;
+            }
+            out << "\t};" << endl << endl;
+
+            out << "\tint run(chip8& core, ch8Registers& r, int budget) {" << endl;
+            out << "\t\tint n = 0;" << endl;
+            out << "\tdispatch:" << endl;
+            out << "\t\tswitch (r.regPC) {" << endl;
+            for (size_t i = 0; i < cases.size(); ++i) {
+                uint32_t address = cases[i].first;
+                const string& code = cases[i].second;
+
+                out << "\t\tcase " << hex(address) << ":";
+                if (labeled[address]) out << " a_" << hex(address).substr(2) << ":";
+                out << " if (n == budget) { r.regPC = " << hex(address) << "; return n; }\t\t// " << hex(word(address), 4).substr(2) << endl;
+                out << "\t\t\t" << code << endl;
+            }
+            out << "\t\tdefault:" << endl;
+            out << "\t\t\treturn n;" << endl;
+            out << "\t\t}" << endl;
+            out << "\t}" << endl << endl;
+
+            out << "\tconst ch8CompiledROM compiled = { \"" << name << "\", rom, sizeof(rom), " << (longInstructions ? "true" : "false")
+                << ", codeRanges, std::size(codeRanges), run };" << endl;
+            out << "\tconst ch8CompiledRegistration registration(compiled);" << endl;
+            out << "}" << endl;
+        }
+
+        size_t instructionCount() const {
+            size_t count = 0;
+            for (bool found : reached) count += found;
+            return count;
+        }
+    };
+}
+
+int main(int argc, char** argv)
+{
+    vector<string> args;
+    bool longInstructions = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--platform=xochip") longInstructions = true;
+        else if (arg == "--platform=chip8" || arg == "--platform=schip") longInstructions = false;
+        else args.push_back(arg);
+    }
+
+    if (args.size() < 2) {
+        cout << "Usage: ch8aot romfile outputfile [--platform=chip8|schip|xochip]" << endl;
+        cout << "(writes C++ source of the ROM, the emulator runs it natively when linked in - see CH8_AOT_ROMS in CMakeLists.txt)" << endl;
+        return 1;
+    }
+
+    ifstream file(args[0], ios::binary);
+    if (!file.good()) {
+        cout << "Couldn't open ROM file!" << endl;
+        return 1;
+    }
+    vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    uint32_t memorySize = longInstructions ? MEMORY_SIZE : CHIP8_MEMORY_SIZE;
+    if (PC_START_ADDRESS + rom.size() > memorySize) {
+        cout << "ROM too large for memory!" << endl;
+        return 1;
+    }
+
+    translator translated(std::move(rom), longInstructions);
+    translated.findCode();
+    if (translated.instructionCount() == 0) {
+        cout << "No instructions to translate!" << endl;
+        return 1;
+    }
+
+    ofstream outFile(args[1]);
+    if (!outFile.good()) {
+        cout << "Couldn't create output file!" << endl;
+        return 1;
+    }
+    translated.write(outFile, filesystem::path(args[0]).filename().string());
+
+    cout << "Translated " << translated.instructionCount() << " instructions" << endl;
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "audio.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+constexpr uint32_t SOUND_REQUEST_BIT = 1u << 31;		// distinguishes "play 0 samples" (stop) from no request
+
+atomic<ch8Audio*> ch8Audio::instance{ nullptr };
+
+ch8Audio::ch8Audio() {
+	if (instance.load() != nullptr) throw runtime_error("Only one audio output can exist!");
+
+	// small buffers -> sound starts soon after the sound timer is set
+	SetAudioStreamBufferSizeDefault(AUDIO_BUFFER_SAMPLES);
+	stream.Load(AUDIO_SAMPLE_RATE, 32, 1);		// 32 bit float mono
+
+	// recorded buzzer sound replaces the generated one if provided
+	const string buzzerPath = "buzzer.wav";
+	if (filesystem::exists(buzzerPath)) loadBuzzerFile(buzzerPath);
+
+	instance.store(this);
+	stream.SetCallback(audioCallback);
+	stream.Play();
+}
+
+ch8Audio::~ch8Audio() noexcept {
+	stream.Stop();
+	instance.store(nullptr);
+}
+
+void ch8Audio::loadBuzzerFile(const string& path) {
+	raylib::Wave wave(path);
+	wave.Format(AUDIO_SAMPLE_RATE, 32, 1);		// same format as the stream -> samples are just copied
+
+	float* samples = wave.LoadSamples();
+	buzzerSamples.assign(samples, samples + wave.frameCount);
+	raylib::Wave::UnloadSamples(samples);
+}
+
+// sound timer counts down 60 times per second -> value is converted to number of samples
+void ch8Audio::setSoundTimer(uint8_t value) {
+	uint32_t samples = value * AUDIO_SAMPLE_RATE / STANDARD_FPS;
+	uint32_t head = soundQueueHead.load(memory_order_relaxed);
+	if (head - soundQueueTail.load(memory_order_acquire) == SOUND_QUEUE_SIZE) {
+		soundRequest.store(SOUND_REQUEST_BIT | samples);		// audio thread is behind - only the newest change is kept
+		return;
+	}
+
+	soundQueue[head % SOUND_QUEUE_SIZE] = { chrono::steady_clock::now().time_since_epoch().count(), samples };
+	soundQueueHead.store(head + 1, memory_order_release);
+}
+
+// only the emulation thread writes -> sequence lock doesn't need to handle multiple writers
+void ch8Audio::setTone(const array<uint8_t, AUDIO_PATTERN_BYTES>& newPattern, uint8_t pitch) {
+	uint32_t sequence = toneSequence.load(memory_order_relaxed);
+	toneSequence.store(sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	for (int i = 0; i < AUDIO_PATTERN_BYTES; ++i) {
+		tonePattern[i].store(newPattern[i], memory_order_relaxed);
+	}
+	tonePitch.store(pitch, memory_order_relaxed);
+
+	toneSequence.store(sequence + 2, memory_order_release);
+}
+
+void ch8Audio::setMuted(bool mute) {
+	muted.store(mute);
+}
+
+
+//============ Audio thread ============//
+
+void ch8Audio::audioCallback(void* buffer, unsigned int frames) {
+	ch8Audio* audio = instance.load();
+	if (audio != nullptr) audio->fillBuffer(static_cast<float*>(buffer), frames);
+	else fill_n(static_cast<float*>(buffer), frames, 0.0f);
+}
+
+// pattern is played at 4000 * 2^((pitch - 64) / 48) samples per second -> precomputed phase step for every pitch value
+uint32_t ch8Audio::pitchStep(uint8_t pitch) {
+	static const array<uint32_t, 256> stepTable = [] {
+		array<uint32_t, 256> table{};
+		for (int i = 0; i < 256; ++i) {
+			double patternRate = 4000.0 * pow(2.0, (i - DEFAULT_PITCH) / 48.0);
+			table[i] = static_cast<uint32_t>(patternRate / AUDIO_SAMPLE_RATE / (AUDIO_PATTERN_BYTES * 8) * 4294967296.0);		// 2^32 = whole pattern
+		}
+		return table;
+	}();
+
+	return stepTable[pitch];
+}
+
+// takes new pattern and pitch if the emulation thread changed them (and isn't just writing them)
+void ch8Audio::readTone() {
+	uint32_t sequence = toneSequence.load(memory_order_acquire);
+	if (sequence == seenToneSequence || (sequence & 1) != 0) return;
+
+	array<uint8_t, AUDIO_PATTERN_BYTES> newPattern;
+	for (int i = 0; i < AUDIO_PATTERN_BYTES; ++i) {
+		newPattern[i] = tonePattern[i].load(memory_order_relaxed);
+	}
+	uint8_t pitch = tonePitch.load(memory_order_relaxed);
+
+	atomic_thread_fence(memory_order_acquire);
+	if (toneSequence.load(memory_order_relaxed) != sequence) return;		// changed while reading -> try again with the next buffer
+
+	pattern = newPattern;
+	patternStep = pitchStep(pitch);
+	usePattern = true;
+	seenToneSequence = sequence;
+}
+
+void ch8Audio::startSound(uint32_t samples) {
+	if (remainingSamples == 0) {		// new sound starts from the beginning
+		phase = 0.0f;
+		buzzerPosition = 0;
+		patternPhase = 0;
+	}
+	remainingSamples = samples;
+}
+
+void ch8Audio::fillBuffer(float* samples, unsigned int count) {
+	readTone();
+
+	// events of the time since the last callback are spread over this buffer the same way
+	int64_t now = chrono::steady_clock::now().time_since_epoch().count();
+	int64_t bufferTicks = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(static_cast<double>(count) / AUDIO_SAMPLE_RATE)).count();
+	int64_t since = (lastCallbackTime != 0 && now > lastCallbackTime) ? lastCallbackTime : now - bufferTicks;
+	lastCallbackTime = now;
+
+	uint32_t tail = soundQueueTail.load(memory_order_relaxed);
+	uint32_t head = soundQueueHead.load(memory_order_acquire);
+	bool muteNow = muted.load();
+
+	for (unsigned int i = 0; i < count; ++i) {
+		while (tail != head) {
+			const soundEvent& event = soundQueue[tail % SOUND_QUEUE_SIZE];
+			int64_t offset = (event.time - since) * count / (now - since);
+			if (offset > static_cast<int64_t>(i)) break;
+			startSound(event.samples);
+			++tail;
+		}
+
+		if (muteNow) {
+			samples[i] = 0.0f;		// remaining length is kept for when the emulation continues
+			continue;
+		}
+		if (remainingSamples == 0) {
+			samples[i] = 0.0f;
+			continue;
+		}
+		--remainingSamples;
+
+		if (usePattern) {
+			uint32_t bit = patternPhase >> 25;		// top 7 bits = index of one of the 128 samples
+			samples[i] = ((pattern[bit >> 3] >> (7 - (bit & 7))) & 1) ? BUZZER_VOLUME : -BUZZER_VOLUME;
+			patternPhase += patternStep;
+		}
+		else if (!buzzerSamples.empty()) {
+			samples[i] = buzzerSamples[buzzerPosition];
+			buzzerPosition = (buzzerPosition + 1) % buzzerSamples.size();
+		}
+		else {
+			samples[i] = (phase < 0.5f) ? BUZZER_VOLUME : -BUZZER_VOLUME;
+			phase += BUZZER_FREQUENCY / AUDIO_SAMPLE_RATE;
+			if (phase >= 1.0f) phase -= 1.0f;
+		}
+	}
+	soundQueueTail.store(tail, memory_order_release);		// events made during this callback stay for the next buffer
+
+	uint32_t request = soundRequest.exchange(0);
+	if (request & SOUND_REQUEST_BIT) startSound(request & ~SOUND_REQUEST_BIT);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "raylib.h"
+#include "../lib/raylib-cpp-5.0.0/include/raylib-cpp.hpp"
+
+#include "state.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr unsigned int AUDIO_SAMPLE_RATE = 44100;
+constexpr int AUDIO_BUFFER_SAMPLES = 512;		// samples requested by one callback (~12 ms)
+constexpr float BUZZER_FREQUENCY = 440.0f;		// pitch of the generated square wave
+constexpr float BUZZER_VOLUME = 0.15f;
+constexpr uint32_t SOUND_QUEUE_SIZE = 256;		// sound timer changes waiting for the audio thread (power of two)
+
+// buzzer generated sample by sample on the audio thread (raylib AudioStream callback)
+// the core only reports changes of the sound timer, the audio thread counts it down itself -> no per-frame audio work
+// changes are timestamped and applied at the matching sample of the next buffer (one buffer of latency), so short
+// sounds keep their start and length instead of snapping to buffer boundaries
+class ch8Audio {
+private:
+	raylib::AudioDevice device;
+	raylib::AudioStream stream;
+
+	// sound timer change - new sound length in samples, made at time (steady_clock ticks)
+	struct soundEvent {
+		int64_t time;
+		uint32_t samples;
+	};
+
+	// emulation thread -> audio thread (single producer, single consumer)
+	std::array<soundEvent, SOUND_QUEUE_SIZE> soundQueue{};
+	std::atomic<uint32_t> soundQueueHead{ 0 };		// written by the emulation thread
+	std::atomic<uint32_t> soundQueueTail{ 0 };		// written by the audio thread
+	std::atomic<uint32_t> soundRequest{ 0 };		// newest change when the queue was full (with SOUND_REQUEST_BIT), applied after the queue
+	std::atomic<bool> muted{ false };
+
+	// XO-CHIP pattern and pitch - written by the emulation thread under a sequence lock (odd = being written)
+	std::atomic<uint32_t> toneSequence{ 0 };
+	std::array<std::atomic<uint8_t>, AUDIO_PATTERN_BYTES> tonePattern{};
+	std::atomic<uint8_t> tonePitch{ DEFAULT_PITCH };
+
+	// audio thread only
+	int64_t lastCallbackTime = 0;			// events made since then belong to the buffer being filled
+	uint32_t remainingSamples = 0;
+	float phase = 0.0f;						// position in one period of the square wave (0 - 1)
+	std::vector<float> buzzerSamples;		// buzzer.wav in stream format (empty = generated square wave)
+	size_t buzzerPosition = 0;
+	uint32_t seenToneSequence = 0;
+	bool usePattern = false;
+	std::array<uint8_t, AUDIO_PATTERN_BYTES> pattern{};
+	uint32_t patternPhase = 0;		// position in the pattern (whole range of uint32_t = 128 samples)
+	uint32_t patternStep = 0;		// added every output sample - taken from the pitch table
+
+	static std::atomic<ch8Audio*> instance;		// raylib callbacks have no user pointer -> only one ch8Audio can exist
+	static void audioCallback(void* buffer, unsigned int frames);
+	void fillBuffer(float* samples, unsigned int count);
+	void startSound(uint32_t samples);
+	void readTone();
+	static uint32_t pitchStep(uint8_t pitch);
+
+	void loadBuzzerFile(const std::string& path);
+
+public:
+	ch8Audio();
+	~ch8Audio() noexcept;
+
+	void setSoundTimer(uint8_t value);		// called by the core whenever FX18 sets the sound timer
+	void setTone(const std::array<uint8_t, AUDIO_PATTERN_BYTES>& newPattern, uint8_t pitch);		// called by the core on F002 and FX3A
+	void setMuted(bool mute);				// timer doesn't run while the emulation is paused
+};
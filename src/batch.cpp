@@ -0,0 +1,441 @@
+#include "batch.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+// AVX2 code is compiled for that target function by function and only called when the CPU has it,
+// so nothing else in the program (inline functions shared with other files included) ends up with AVX2 instructions
+#if defined(CH8_AVX2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CH8_BATCH_AVX2
+#define CH8_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(__AVX2__)		// MSVC has no per-function targets - only when the whole program is built with /arch:AVX2
+#define CH8_BATCH_AVX2
+#define CH8_TARGET_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// instructions executed for all lanes at once - everything else runs on the lane's own core
+enum class ch8Batch::LockstepOp : uint8_t {
+	LOAD_IMMEDIATE,				// 6XNN
+	ADD_IMMEDIATE,				// 7XNN
+	LOAD,						// 8XY0
+	OR,							// 8XY1
+	AND,						// 8XY2
+	XOR,						// 8XY3
+	ADD,						// 8XY4
+	SUBTRACT,					// 8XY5
+	SHIFT_RIGHT,				// 8XY6
+	SUBTRACT_NEGATIVE,			// 8XY7
+	SHIFT_LEFT,					// 8XYE
+	SKIP_IF_EQUAL,				// 3XNN
+	SKIP_IF_NOT_EQUAL,			// 4XNN
+	SKIP_IF_REGS_EQUAL,			// 5XY0
+	SKIP_IF_REGS_NOT_EQUAL,		// 9XY0
+	JUMP,						// 1NNN
+	LOAD_ADDRESS,				// ANNN
+	ADD_TO_I,					// FX1E
+	LOAD_DELAY,					// FX07
+	SET_DELAY,					// FX15
+	SET_SOUND,					// FX18
+	NONE
+};
+
+// skips of XO-CHIP look at the next instruction (F000 NNNN is two words long) -> left to the cores
+ch8Batch::LockstepOp ch8Batch::decodeLockstep(uint16_t instruction, bool longInstructions) {
+	switch (instruction & 0xF000) {
+	case 0x1000: return LockstepOp::JUMP;
+	case 0x3000: return longInstructions ? LockstepOp::NONE : LockstepOp::SKIP_IF_EQUAL;
+	case 0x4000: return longInstructions ? LockstepOp::NONE : LockstepOp::SKIP_IF_NOT_EQUAL;
+	case 0x5000: return ((instruction & 0x000F) == 0 && !longInstructions) ? LockstepOp::SKIP_IF_REGS_EQUAL : LockstepOp::NONE;
+	case 0x6000: return LockstepOp::LOAD_IMMEDIATE;
+	case 0x7000: return LockstepOp::ADD_IMMEDIATE;
+	case 0x8000:
+		switch (instruction & 0x000F) {
+		case 0x0: return LockstepOp::LOAD;
+		case 0x1: return LockstepOp::OR;
+		case 0x2: return LockstepOp::AND;
+		case 0x3: return LockstepOp::XOR;
+		case 0x4: return LockstepOp::ADD;
+		case 0x5: return LockstepOp::SUBTRACT;
+		case 0x6: return LockstepOp::SHIFT_RIGHT;
+		case 0x7: return LockstepOp::SUBTRACT_NEGATIVE;
+		case 0xE: return LockstepOp::SHIFT_LEFT;
+		}
+		break;
+	case 0x9000: return ((instruction & 0x000F) == 0 && !longInstructions) ? LockstepOp::SKIP_IF_REGS_NOT_EQUAL : LockstepOp::NONE;
+	case 0xA000: return LockstepOp::LOAD_ADDRESS;
+	case 0xF000:
+		switch (instruction & 0x00FF) {
+		case 0x07: return LockstepOp::LOAD_DELAY;
+		case 0x15: return LockstepOp::SET_DELAY;
+		case 0x18: return LockstepOp::SET_SOUND;
+		case 0x1E: return LockstepOp::ADD_TO_I;
+		}
+		break;
+	}
+	return LockstepOp::NONE;
+}
+
+namespace {
+#ifdef CH8_BATCH_AVX2
+	bool cpuHasAVX2() {
+#if defined(__GNUC__) || defined(__clang__)
+		static const bool supported = __builtin_cpu_supports("avx2");
+		return supported;
+#else
+		return true;		// the whole program needs it anyway
+#endif
+	}
+
+	CH8_TARGET_AVX2 __m256i load256(const void* address) { return _mm256_loadu_si256(static_cast<const __m256i*>(address)); }
+	CH8_TARGET_AVX2 void store256(void* address, __m256i value) { _mm256_storeu_si256(static_cast<__m256i*>(address), value); }
+#else
+	bool cpuHasAVX2() { return false; }
+#endif
+}
+
+ch8Batch::ch8Batch(const ch8Options& options, int count, uint32_t seed)
+	: laneCount(count)
+	, paddedCount((count + BATCH_LANE_ALIGN - 1) / BATCH_LANE_ALIGN * BATCH_LANE_ALIGN)
+	, longInstructions(options.platform == ch8Platform::XOCHIP)
+	, activeCount(count)
+{
+	if (count <= 0) throw runtime_error("Batch needs at least one lane!");
+
+	// lanes are never shown, so nothing is explained, profiled or traced
+	ch8Options laneOptions = options;
+	laneOptions.enableExplanations = false;
+	laneOptions.enableProfiling = false;
+	laneOptions.tracePath.clear();
+
+	for (vector<uint8_t>& reg : regsVx) reg.assign(paddedCount, 0);
+	for (vector<uint16_t>& level : stack) level.assign(paddedCount, 0);
+	regPC.assign(paddedCount, 0);
+	regI.assign(paddedCount, 0);
+	regDT.assign(paddedCount, 0);
+	regST.assign(paddedCount, 0);
+	regSP.assign(paddedCount, 0);
+	activeMask.assign(paddedCount, 0);
+	activeMask16.assign(paddedCount, 0);
+	errors.resize(laneCount);
+
+	for (int lane = 0; lane < laneCount; ++lane) {
+		lanes.push_back(make_unique<chip8>(laneOptions));
+		lanes[lane]->seedRandom(seed + lane);
+		storeRegisters(lane, lanes[lane]->getRegisters());
+		activeMask[lane] = 0xFF;
+		activeMask16[lane] = 0xFFFF;
+	}
+}
+
+void ch8Batch::loadROM(const string& fileName) {
+	for (unique_ptr<chip8>& lane : lanes) lane->loadROM(fileName);
+	laneWrittenAddresses.reset();		// all lanes have the same memory again
+}
+
+void ch8Batch::setKeypad(int lane, uint16_t held, uint16_t pressed) {
+	lanes[lane]->setKeypad(held, pressed);
+}
+
+ch8Registers ch8Batch::loadRegisters(int lane) const {
+	ch8Registers registers;
+	registers.regPC = regPC[lane];
+	registers.regI = regI[lane];
+	for (int i = 0; i < VREGS_COUNT; ++i) registers.regsVx[i] = regsVx[i][lane];
+	registers.regDT = regDT[lane];
+	registers.regST = regST[lane];
+	registers.regSP = regSP[lane];
+	for (int i = 0; i < STACK_SIZE; ++i) registers.stack[i] = stack[i][lane];
+	return registers;
+}
+
+void ch8Batch::storeRegisters(int lane, const ch8Registers& registers) {
+	regPC[lane] = registers.regPC;
+	regI[lane] = registers.regI;
+	for (int i = 0; i < VREGS_COUNT; ++i) regsVx[i][lane] = registers.regsVx[i];
+	regDT[lane] = registers.regDT;
+	regST[lane] = registers.regST;
+	regSP[lane] = registers.regSP;
+	for (int i = 0; i < STACK_SIZE; ++i) stack[i][lane] = registers.stack[i];
+}
+
+void ch8Batch::fault(int lane, const string& error) {
+	activeMask[lane] = 0;
+	activeMask16[lane] = 0;
+	errors[lane] = error;
+	--activeCount;
+}
+
+//============ Execution ============//
+
+void ch8Batch::emulateOneFrame(int IPC) {
+	for (int i = 0; i < IPC && activeCount > 0; ) {
+		uint16_t address;
+		uint16_t instruction;
+		bool agree = lanesAgree(address, instruction);
+		if (agree && executeLockstep(address, instruction)) {
+			lockstepInstructions += activeCount;
+			++i;
+			continue;
+		}
+
+		// lanes at the same instruction usually stay together -> check again right after it
+		int count = agree ? 1 : min(DIVERGED_BURST, IPC - i);
+		for (int lane = 0; lane < laneCount; ++lane) executeLane(lane, count);
+		i += count;
+	}
+
+	// lower timers of running lanes
+	if (cpuHasAVX2()) lowerTimersAVX2();
+	else {
+		for (int lane = 0; lane < laneCount; ++lane) {
+			if (!activeMask[lane]) continue;
+			if (regDT[lane] != 0) --regDT[lane];
+			if (regST[lane] != 0) --regST[lane];
+		}
+	}
+
+	// the lane's core decides, it needs the registers for that
+	for (int lane = 0; lane < laneCount; ++lane) {
+		if (!activeMask[lane]) continue;
+		lanes[lane]->setRegisters(loadRegisters(lane));
+		lanes[lane]->checkHalted(IPC);
+	}
+}
+
+// true when every running lane is about to execute the same instruction at the same address
+bool ch8Batch::lanesAgree(uint16_t& address, uint16_t& instruction) const {
+	int first = 0;
+	while (!activeMask[first]) ++first;		// there is always one (checked by emulateOneFrame)
+	address = regPC[first];
+
+	if (cpuHasAVX2()) {
+		if (!sameAddressAVX2(address)) return false;
+	}
+	else {
+		for (int lane = 0; lane < laneCount; ++lane) {
+			if (activeMask[lane] && regPC[lane] != address) return false;
+		}
+	}
+
+	// address out of memory gives 0 (no lockstep form) -> every lane reports the fault on its own
+	instruction = lanes[first]->peekInstruction(address);
+
+	// code written by the lanes themselves may differ
+	if (laneWrittenAddresses[address] || laneWrittenAddresses[(address + 1) & (MEMORY_SIZE - 1)]) {
+		for (int lane = first + 1; lane < laneCount; ++lane) {
+			if (activeMask[lane] && lanes[lane]->peekInstruction(address) != instruction) return false;
+		}
+	}
+	return true;
+}
+
+// same semantics as the handlers in chip8.cpp, lanes which stopped on an error keep their registers
+bool ch8Batch::executeLockstep(uint16_t address, uint16_t instruction) {
+	LockstepOp op = decodeLockstep(instruction, longInstructions);
+	if (op == LockstepOp::NONE) return false;
+
+	int x = (instruction & 0x0F00) >> 8;
+	int y = (instruction & 0x00F0) >> 4;
+	uint8_t value = instruction & 0x00FF;
+	uint16_t nextPC = (op == LockstepOp::JUMP) ? (instruction & 0x0FFF) : static_cast<uint16_t>(address + INSTRUCTION_BYTES);
+
+	bool writesVx = true;
+	bool writesFlag = false;
+	switch (op) {
+	case LockstepOp::OR: case LockstepOp::AND: case LockstepOp::XOR:
+	case LockstepOp::ADD: case LockstepOp::SUBTRACT: case LockstepOp::SUBTRACT_NEGATIVE:
+	case LockstepOp::SHIFT_RIGHT: case LockstepOp::SHIFT_LEFT:
+		writesFlag = true;
+		break;
+	case LockstepOp::SKIP_IF_EQUAL: case LockstepOp::SKIP_IF_NOT_EQUAL:
+	case LockstepOp::SKIP_IF_REGS_EQUAL: case LockstepOp::SKIP_IF_REGS_NOT_EQUAL:
+	case LockstepOp::JUMP: case LockstepOp::LOAD_ADDRESS: case LockstepOp::ADD_TO_I:
+	case LockstepOp::SET_DELAY: case LockstepOp::SET_SOUND:
+		writesVx = false;
+		break;
+	default:
+		break;
+	}
+
+	if (cpuHasAVX2()) {
+		executeLockstepAVX2(op, instruction, nextPC, writesVx, writesFlag);
+		return true;
+	}
+
+	for (int lane = 0; lane < laneCount; ++lane) {
+		if (!activeMask[lane]) continue;
+
+		uint8_t vx = regsVx[x][lane];
+		uint8_t vy = regsVx[y][lane];
+		uint8_t result = vx;
+		uint8_t flag = 0;
+		bool skip = false;
+
+		switch (op) {
+		case LockstepOp::LOAD_IMMEDIATE: result = value; break;
+		case LockstepOp::ADD_IMMEDIATE: result = vx + value; break;
+		case LockstepOp::LOAD: result = vy; break;
+		case LockstepOp::OR: result = vx | vy; break;
+		case LockstepOp::AND: result = vx & vy; break;
+		case LockstepOp::XOR: result = vx ^ vy; break;
+		case LockstepOp::ADD: result = vx + vy; flag = result < vx; break;
+		case LockstepOp::SUBTRACT: result = vx - vy; flag = vx >= vy; break;
+		case LockstepOp::SUBTRACT_NEGATIVE: result = vy - vx; flag = vy >= vx; break;
+		case LockstepOp::SHIFT_RIGHT: result = vy >> 1; flag = vy & 0x01; break;
+		case LockstepOp::SHIFT_LEFT: result = vy << 1; flag = vy >> 7; break;
+		case LockstepOp::SKIP_IF_EQUAL: skip = vx == value; break;
+		case LockstepOp::SKIP_IF_NOT_EQUAL: skip = vx != value; break;
+		case LockstepOp::SKIP_IF_REGS_EQUAL: skip = vx == vy; break;
+		case LockstepOp::SKIP_IF_REGS_NOT_EQUAL: skip = vx != vy; break;
+		case LockstepOp::LOAD_ADDRESS: regI[lane] = instruction & 0x0FFF; break;
+		case LockstepOp::ADD_TO_I: regI[lane] += vx; break;
+		case LockstepOp::LOAD_DELAY: result = regDT[lane]; break;
+		case LockstepOp::SET_DELAY: regDT[lane] = vx; break;
+		case LockstepOp::SET_SOUND: regST[lane] = vx; break;
+		default: break;
+		}
+
+		if (writesVx) regsVx[x][lane] = result;
+		if (writesFlag) regsVx[0xF][lane] = flag;
+		regPC[lane] = nextPC + (skip ? INSTRUCTION_BYTES : 0);
+	}
+
+	return true;
+}
+
+#ifdef CH8_BATCH_AVX2
+// same as the loops above, 32 lanes at a time (padding lanes are never active, so they are left as they are)
+CH8_TARGET_AVX2 void ch8Batch::lowerTimersAVX2() {
+	const __m256i one = _mm256_set1_epi8(1);
+	for (int lane = 0; lane < paddedCount; lane += BATCH_LANE_ALIGN) {
+		__m256i active = load256(&activeMask[lane]);
+		__m256i delay = load256(&regDT[lane]);
+		__m256i sound = load256(&regST[lane]);
+		store256(&regDT[lane], _mm256_blendv_epi8(delay, _mm256_subs_epu8(delay, one), active));		// saturating -> stays at zero
+		store256(&regST[lane], _mm256_blendv_epi8(sound, _mm256_subs_epu8(sound, one), active));
+	}
+}
+
+CH8_TARGET_AVX2 bool ch8Batch::sameAddressAVX2(uint16_t address) const {
+	const __m256i expected = _mm256_set1_epi16(static_cast<short>(address));
+	for (int lane = 0; lane < paddedCount; lane += BATCH_LANE_ALIGN / 2) {
+		__m256i differs = _mm256_andnot_si256(_mm256_cmpeq_epi16(load256(&regPC[lane]), expected), load256(&activeMask16[lane]));
+		if (!_mm256_testz_si256(differs, differs)) return false;
+	}
+	return true;
+}
+
+CH8_TARGET_AVX2 void ch8Batch::executeLockstepAVX2(LockstepOp op, uint16_t instruction, uint16_t nextPC, bool writesVx, bool writesFlag) {
+	int x = (instruction & 0x0F00) >> 8;
+	int y = (instruction & 0x00F0) >> 4;
+	uint8_t value = instruction & 0x00FF;
+
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i immediate = _mm256_set1_epi8(static_cast<char>(value));
+	const __m256i allOnes = _mm256_set1_epi8(-1);
+
+	for (int lane = 0; lane < paddedCount; lane += BATCH_LANE_ALIGN) {
+		__m256i active = load256(&activeMask[lane]);
+		__m256i vx = load256(&regsVx[x][lane]);
+		__m256i vy = load256(&regsVx[y][lane]);
+		__m256i result = vx;
+		__m256i flag = _mm256_setzero_si256();		// OR, AND and XOR reset VF
+		__m256i skip = _mm256_setzero_si256();		// 0xFF in lanes which skip the next instruction
+
+		switch (op) {
+		case LockstepOp::LOAD_IMMEDIATE: result = immediate; break;
+		case LockstepOp::ADD_IMMEDIATE: result = _mm256_add_epi8(vx, immediate); break;
+		case LockstepOp::LOAD: result = vy; break;
+		case LockstepOp::OR: result = _mm256_or_si256(vx, vy); break;
+		case LockstepOp::AND: result = _mm256_and_si256(vx, vy); break;
+		case LockstepOp::XOR: result = _mm256_xor_si256(vx, vy); break;
+		case LockstepOp::ADD:
+			result = _mm256_add_epi8(vx, vy);
+			flag = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(result, vx), result), one);		// carry -> result < Vx
+			break;
+		case LockstepOp::SUBTRACT:
+			result = _mm256_sub_epi8(vx, vy);
+			flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(vx, vy), vx), one);		// not borrow -> Vx >= Vy
+			break;
+		case LockstepOp::SUBTRACT_NEGATIVE:
+			result = _mm256_sub_epi8(vy, vx);
+			flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(vy, vx), vy), one);
+			break;
+		case LockstepOp::SHIFT_RIGHT:		// quirk - shifted Vy is stored into Vx
+			result = _mm256_and_si256(_mm256_srli_epi16(vy, 1), _mm256_set1_epi8(0x7F));		// no byte shifts -> mask bits from the neighbouring byte
+			flag = _mm256_and_si256(vy, one);
+			break;
+		case LockstepOp::SHIFT_LEFT:
+			result = _mm256_add_epi8(vy, vy);
+			flag = _mm256_and_si256(_mm256_srli_epi16(vy, 7), one);
+			break;
+		case LockstepOp::SKIP_IF_EQUAL: skip = _mm256_cmpeq_epi8(vx, immediate); break;
+		case LockstepOp::SKIP_IF_NOT_EQUAL: skip = _mm256_xor_si256(_mm256_cmpeq_epi8(vx, immediate), allOnes); break;
+		case LockstepOp::SKIP_IF_REGS_EQUAL: skip = _mm256_cmpeq_epi8(vx, vy); break;
+		case LockstepOp::SKIP_IF_REGS_NOT_EQUAL: skip = _mm256_xor_si256(_mm256_cmpeq_epi8(vx, vy), allOnes); break;
+		case LockstepOp::LOAD_DELAY: result = load256(&regDT[lane]); break;
+		case LockstepOp::SET_DELAY: store256(&regDT[lane], _mm256_blendv_epi8(load256(&regDT[lane]), vx, active)); break;
+		case LockstepOp::SET_SOUND: store256(&regST[lane], _mm256_blendv_epi8(load256(&regST[lane]), vx, active)); break;
+		default: break;
+		}
+
+		// VF is written last - it wins when X is F
+		if (writesVx) store256(&regsVx[x][lane], _mm256_blendv_epi8(vx, result, active));
+		if (writesFlag) store256(&regsVx[0xF][lane], _mm256_blendv_epi8(load256(&regsVx[0xF][lane]), flag, active));
+
+		// 16-bit registers hold half as many lanes in one AVX2 register
+		for (int half = 0; half < 2; ++half) {
+			int wordLane = lane + half * BATCH_LANE_ALIGN / 2;
+			__m256i active16 = load256(&activeMask16[wordLane]);
+			__m128i skipHalf = half ? _mm256_extracti128_si256(skip, 1) : _mm256_castsi256_si128(skip);
+			__m256i pc = _mm256_add_epi16(_mm256_set1_epi16(static_cast<short>(nextPC)),
+				_mm256_and_si256(_mm256_cvtepi8_epi16(skipHalf), _mm256_set1_epi16(INSTRUCTION_BYTES)));
+			store256(&regPC[wordLane], _mm256_blendv_epi8(load256(&regPC[wordLane]), pc, active16));
+
+			if (op == LockstepOp::LOAD_ADDRESS || op == LockstepOp::ADD_TO_I) {
+				__m256i oldI = load256(&regI[wordLane]);
+				__m128i vxHalf = half ? _mm256_extracti128_si256(vx, 1) : _mm256_castsi256_si128(vx);
+				__m256i newI = (op == LockstepOp::LOAD_ADDRESS) ? _mm256_set1_epi16(static_cast<short>(instruction & 0x0FFF))
+					: _mm256_add_epi16(oldI, _mm256_cvtepu8_epi16(vxHalf));
+				store256(&regI[wordLane], _mm256_blendv_epi8(oldI, newI, active16));
+			}
+		}
+	}
+}
+#else
+// never called - cpuHasAVX2 is false
+void ch8Batch::lowerTimersAVX2() {}
+bool ch8Batch::sameAddressAVX2(uint16_t) const { return false; }
+void ch8Batch::executeLockstepAVX2(LockstepOp, uint16_t, uint16_t, bool, bool) {}
+#endif
+
+// runs instructions of one lane on its own core (registers are moved there and back)
+void ch8Batch::executeLane(int lane, int count) {
+	if (!activeMask[lane]) return;
+
+	chip8& core = *lanes[lane];
+	ch8Registers registers = loadRegisters(lane);
+	core.setRegisters(registers);
+
+	int executed = 0;
+	for (; executed < count; ++executed) {
+		// remember what the lane writes - other lanes may not have the same content there anymore
+		uint16_t instruction = core.peekInstruction(registers.regPC);
+		int writeLength = chip8::memoryWriteLength(instruction);
+		for (int i = 0; i < writeLength; ++i) laneWrittenAddresses[(registers.regI + i) & (MEMORY_SIZE - 1)] = true;
+
+		ch8Fault stopped = core.step();
+		registers = core.getRegisters();		// changes made before a fault stay (same as a stopped core)
+		if (stopped != ch8Fault::NONE) {
+			fault(lane, core.describeFault());
+			break;
+		}
+	}
+
+	storeRegisters(lane, registers);
+	laneInstructions += executed;
+}
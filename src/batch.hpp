@@ -0,0 +1,79 @@
+#pragma once
+
+#include "chip8.hpp"
+#include "options.hpp"
+
+#include <array>
+#include <bitset>
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+constexpr int BATCH_LANE_ALIGN = 32;		// lanes are padded to a whole AVX2 register of bytes
+constexpr int DIVERGED_BURST = 16;			// instructions each lane runs on its own before lockstep is checked again
+
+// many instances of the same ROM executed in lockstep (fuzzing, reinforcement learning)
+// registers are stored as structure of arrays - while all lanes are at the same instruction, it is executed for all of them at once (AVX2 when the CPU has it)
+// other instructions and diverged lanes run one lane at a time on its own chip8 core, which also keeps memory, screen, random generator and keypad
+// results are the same as running every lane as a separate chip8 object seeded with seed + lane
+class ch8Batch {
+private:
+	enum class LockstepOp : uint8_t;		// instructions executed for all lanes at once (defined in batch.cpp)
+
+	int laneCount;
+	int paddedCount;		// laneCount rounded up to BATCH_LANE_ALIGN, padding lanes are never active
+	bool longInstructions;	// XO-CHIP skips depend on the next instruction -> they aren't executed in lockstep
+	std::vector<std::unique_ptr<chip8>> lanes;
+
+	// registers - register first, lane second
+	std::array<std::vector<uint8_t>, VREGS_COUNT> regsVx;
+	std::vector<uint16_t> regPC;
+	std::vector<uint16_t> regI;
+	std::vector<uint8_t> regDT;
+	std::vector<uint8_t> regST;
+	std::vector<uint8_t> regSP;
+	std::array<std::vector<uint16_t>, STACK_SIZE> stack;
+
+	// lanes stop after an error (like the emulator does) - their state stays as it was when it happened
+	std::vector<uint8_t> activeMask;		// 0xFF while the lane runs, 0 after an error (padding lanes too)
+	std::vector<uint16_t> activeMask16;		// same for 16-bit registers
+	std::vector<std::string> errors;
+	int activeCount;
+
+	// addresses written by a lane on its own - lanes may have different instructions there
+	std::bitset<MEMORY_SIZE> laneWrittenAddresses;
+
+	uint64_t lockstepInstructions = 0;		// per lane
+	uint64_t laneInstructions = 0;
+
+	ch8Registers loadRegisters(int lane) const;
+	void storeRegisters(int lane, const ch8Registers& registers);
+	bool lanesAgree(uint16_t& address, uint16_t& instruction) const;
+	bool executeLockstep(uint16_t address, uint16_t instruction);		// false when the instruction has no lockstep form
+	static LockstepOp decodeLockstep(uint16_t instruction, bool longInstructions);
+
+	// AVX2 forms of the loops over lanes, only called when the CPU has AVX2
+	void lowerTimersAVX2();
+	bool sameAddressAVX2(uint16_t address) const;
+	void executeLockstepAVX2(LockstepOp op, uint16_t instruction, uint16_t nextPC, bool writesVx, bool writesFlag);
+	void executeLane(int lane, int count);
+	void fault(int lane, const std::string& error);
+
+public:
+	ch8Batch(const ch8Options& options, int count, uint32_t seed);
+
+	void loadROM(const std::string& fileName);		// same ROM for every lane
+	void emulateOneFrame(int IPC);					// IPC instructions for every lane, then timers are lowered
+	void setKeypad(int lane, uint16_t held, uint16_t pressed);
+
+	int size() const { return laneCount; }
+	ch8Registers getRegisters(int lane) const { return loadRegisters(lane); }
+	const ch8FrameBuffer& getFrameBuffer(int lane) const { return lanes[lane]->getFrameBuffer(); }
+	bool isFaulted(int lane) const { return activeMask[lane] == 0; }
+	bool isHalted(int lane) const { return lanes[lane]->isHalted(); }		// see chip8::checkHalted - the lane still runs
+	const std::string& getError(int lane) const { return errors[lane]; }
+
+	uint64_t getLockstepInstructions() const { return lockstepInstructions; }
+	uint64_t getLaneInstructions() const { return laneInstructions; }
+};
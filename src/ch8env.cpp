@@ -0,0 +1,192 @@
+#include "ch8env.h"
+#include "environment.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+struct ch8env {
+	unique_ptr<ch8Environment> environment;
+
+	ch8env_reward_fn rewardFn = nullptr;
+	void* rewardUser = nullptr;
+	ch8env_done_fn doneFn = nullptr;
+	void* doneUser = nullptr;
+};
+
+struct ch8env_state {
+	ch8EnvState state;
+};
+
+namespace {
+	thread_local string lastError;
+
+	// exceptions must not cross the C interface
+	template <typename F>
+	int guarded(F&& body) {
+		try {
+			body();
+			return 0;
+		}
+		catch (const exception& error) {
+			lastError = error.what();
+			return -1;
+		}
+	}
+
+	bool validIndex(const ch8env* env, int index) {
+		if (env && index >= 0 && index < env->environment->size()) return true;
+		lastError = "Invalid environment index!";
+		return false;
+	}
+}
+
+void ch8env_default_config(ch8env_config* config) {
+	config->count = 1;
+	config->frame_skip = 4;
+	config->speed = ch8Options().speed;
+	config->platform = CH8ENV_CHIP8;
+	config->threads = 0;
+	config->seed = 0;
+}
+
+ch8env* ch8env_create(const char* rom_path, const ch8env_config* config) {
+	ch8env* env = nullptr;
+	guarded([&] {
+		if (!rom_path || !config) throw invalid_argument("ROM path and config must not be NULL!");
+		if (config->platform < CH8ENV_CHIP8 || config->platform > CH8ENV_XOCHIP) throw invalid_argument("Unknown platform!");
+
+		ch8Options options;
+		options.speed = config->speed;
+		options.threads = config->threads;
+		if (config->platform == CH8ENV_SCHIP) options.platform = ch8Platform::SCHIP;
+		if (config->platform == CH8ENV_XOCHIP) options.platform = ch8Platform::XOCHIP;
+
+		unique_ptr<ch8env> created = make_unique<ch8env>();
+		created->environment = make_unique<ch8Environment>(options, rom_path, config->count, config->frame_skip, config->seed);
+		env = created.release();
+	});
+	return env;
+}
+
+void ch8env_destroy(ch8env* env) {
+	delete env;
+}
+
+const char* ch8env_last_error(void) {
+	return lastError.c_str();
+}
+
+void ch8env_set_reward_fn(ch8env* env, ch8env_reward_fn fn, void* user) {
+	env->rewardFn = fn;
+	env->rewardUser = user;
+	if (!fn) {
+		env->environment->setRewardHook(nullptr);
+		return;
+	}
+	env->environment->setRewardHook([env](const chip8&, int index) { return env->rewardFn(env, index, env->rewardUser); });
+}
+
+void ch8env_set_done_fn(ch8env* env, ch8env_done_fn fn, void* user) {
+	env->doneFn = fn;
+	env->doneUser = user;
+	if (!fn) {
+		env->environment->setDoneHook(nullptr);
+		return;
+	}
+	env->environment->setDoneHook([env](const chip8&, int index) { return env->doneFn(env, index, env->doneUser) != 0; });
+}
+
+int ch8env_reset(ch8env* env, int index) {
+	if (index == -1) return guarded([&] { env->environment->reset(); });
+	if (!validIndex(env, index)) return -1;
+	return guarded([&] { env->environment->reset(index); });
+}
+
+int ch8env_step(ch8env* env, const uint16_t* actions) {
+	return guarded([&] { env->environment->step(actions); });
+}
+
+const float* ch8env_rewards(const ch8env* env) {
+	return env->environment->getRewards();
+}
+
+const uint8_t* ch8env_dones(const ch8env* env) {
+	return env->environment->getDones();
+}
+
+const char* ch8env_error(const ch8env* env, int index) {
+	if (!validIndex(env, index)) return "";
+	return env->environment->getError(index).c_str();
+}
+
+int ch8env_get_frame(const ch8env* env, int index, ch8env_frame* frame) {
+	if (!validIndex(env, index)) return -1;
+
+	const ch8FrameBuffer& frameBuffer = env->environment->getFrameBuffer(index);
+	frame->words = frameBuffer.data();
+	frame->width = frameBuffer.width();
+	frame->height = frameBuffer.height();
+	frame->row_words = ROW_WORDS;
+	frame->plane_words = PLANE_WORDS;
+	frame->planes = MAX_PLANES;
+	return 0;
+}
+
+int ch8env_get_registers(const ch8env* env, int index, ch8env_registers* registers) {
+	if (!validIndex(env, index)) return -1;
+
+	ch8Registers core = env->environment->getCore(index).getRegisters();
+	registers->pc = core.regPC;
+	registers->i = core.regI;
+	copy(core.regsVx.begin(), core.regsVx.end(), registers->v);
+	registers->dt = core.regDT;
+	registers->st = core.regST;
+	registers->sp = core.regSP;
+	copy(core.stack.begin(), core.stack.end(), registers->stack);
+	return 0;
+}
+
+int ch8env_peek(const ch8env* env, int index, uint16_t address, uint8_t* value) {
+	if (!validIndex(env, index)) return -1;
+
+	const chip8& core = env->environment->getCore(index);
+	if (address >= core.getMemorySize()) {
+		lastError = "Trying to read outside of memory space!";
+		return -1;
+	}
+	*value = core.peekMemory(address);
+	return 0;
+}
+
+int ch8env_state_hash(const ch8env* env, int index, uint64_t* hash) {
+	if (!validIndex(env, index)) return -1;
+
+	*hash = env->environment->getCore(index).hashState();
+	return 0;
+}
+
+ch8env_state* ch8env_clone(const ch8env* env, int index) {
+	if (!validIndex(env, index)) return nullptr;
+
+	ch8env_state* state = nullptr;
+	guarded([&] {
+		unique_ptr<ch8env_state> created = make_unique<ch8env_state>();
+		env->environment->saveState(index, created->state);
+		state = created.release();
+	});
+	return state;
+}
+
+int ch8env_restore(ch8env* env, int index, const ch8env_state* state) {
+	if (!validIndex(env, index)) return -1;
+	return guarded([&] { env->environment->loadState(index, state->state); });
+}
+
+void ch8env_state_free(ch8env_state* state) {
+	delete state;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+/* C interface of ch8Environment - for bindings (Python ctypes/cffi,...), built as the ch8env shared library
+   functions returning int return 0 on success and -1 on error (see ch8env_last_error) */
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define CH8ENV_API __declspec(dllexport)
+#else
+#define CH8ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ch8env ch8env;
+typedef struct ch8env_state ch8env_state;
+
+enum {
+	CH8ENV_CHIP8 = 0,
+	CH8ENV_SCHIP = 1,
+	CH8ENV_XOCHIP = 2
+};
+
+typedef struct ch8env_config {
+	int count;			/* copies of the game */
+	int frame_skip;		/* frames emulated by one step (same action) */
+	int speed;			/* instructions per second */
+	int platform;		/* CH8ENV_CHIP8, CH8ENV_SCHIP or CH8ENV_XOCHIP */
+	int threads;		/* 0 = one per hardware thread */
+	uint32_t seed;
+} ch8env_config;
+
+/* screen of one environment, points directly into the emulator (valid until the next step/reset)
+   every pixel is one bit, lines are row_words 64-bit words (leftmost pixel is the highest bit), planes follow each other */
+typedef struct ch8env_frame {
+	const uint64_t* words;
+	int width;			/* 64 or 128 (SUPER-CHIP high resolution) */
+	int height;			/* 32 or 64 */
+	int row_words;
+	int plane_words;	/* distance between planes */
+	int planes;
+} ch8env_frame;
+
+typedef struct ch8env_registers {
+	uint16_t pc;
+	uint16_t i;
+	uint8_t v[16];
+	uint8_t dt;
+	uint8_t st;
+	uint8_t sp;
+	uint16_t stack[16];
+} ch8env_registers;
+
+/* called after every emulated frame, possibly from several threads at once */
+typedef float (*ch8env_reward_fn)(const ch8env* env, int index, void* user);
+typedef int (*ch8env_done_fn)(const ch8env* env, int index, void* user);
+
+CH8ENV_API void ch8env_default_config(ch8env_config* config);
+CH8ENV_API ch8env* ch8env_create(const char* rom_path, const ch8env_config* config);		/* NULL on error (NULL arguments and unknown platforms too) */
+CH8ENV_API void ch8env_destroy(ch8env* env);
+CH8ENV_API const char* ch8env_last_error(void);		/* of the last failed call on this thread */
+
+CH8ENV_API void ch8env_set_reward_fn(ch8env* env, ch8env_reward_fn fn, void* user);
+CH8ENV_API void ch8env_set_done_fn(ch8env* env, ch8env_done_fn fn, void* user);
+
+CH8ENV_API int ch8env_reset(ch8env* env, int index);		/* -1 = all */
+CH8ENV_API int ch8env_step(ch8env* env, const uint16_t* actions);	/* one action (bit n = keypad key n held) per environment */
+
+/* results of the last step, one per environment - the arrays stay at the same address for the life of env */
+CH8ENV_API const float* ch8env_rewards(const ch8env* env);
+CH8ENV_API const uint8_t* ch8env_dones(const ch8env* env);
+CH8ENV_API const char* ch8env_error(const ch8env* env, int index);	/* error which ended the episode ("" if none) */
+
+CH8ENV_API int ch8env_get_frame(const ch8env* env, int index, ch8env_frame* frame);
+CH8ENV_API int ch8env_get_registers(const ch8env* env, int index, ch8env_registers* registers);
+CH8ENV_API int ch8env_peek(const ch8env* env, int index, uint16_t address, uint8_t* value);	/* memory byte (scores for rewards) */
+CH8ENV_API int ch8env_state_hash(const ch8env* env, int index, uint64_t* hash);	/* equal states have equal hashes (deduplicating searches, determinism checks) */
+
+CH8ENV_API ch8env_state* ch8env_clone(const ch8env* env, int index);
+CH8ENV_API int ch8env_restore(ch8env* env, int index, const ch8env_state* state);
+CH8ENV_API void ch8env_state_free(ch8env_state* state);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,141 +1,519 @@
 
-#include "raylib.h"
-
 #include "chip8.hpp"
 
 #include <iostream>
 #include <iomanip>		// enables setfill() and setw() to pad numbers with zeros
 #include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <sstream>
 #include <stdexcept>
 #include <limits>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <bit>
+#include <span>
 
 using namespace std;
 
-chip8::chip8(int scale, int speed, bool enableExplanations, unsigned int mainColor, unsigned int BGColor)
-	: generator(rd()), distChar(0, numeric_limits<uint8_t>::max())		// setup RNG
-	, display(scale, (speed >= STANDARD_FPS) ? STANDARD_FPS : speed,		// speed too low -> lower framerate
-		regPC, regI, regsVx, regDT, regST, regSP, stack,
-		explanations, lastInstructions, enableExplanations,
-		mainColor, BGColor)
-	, enableExplanations(enableExplanations)
+namespace {
+	// explanations and trace need every instruction to be executed separately
+	bool fusionAllowed(const ch8Options& options) {
+		return options.enableFusion && !options.enableExplanations && options.tracePath.empty();
+	}
+
+	// translated code doesn't count waiting for automatic speed either
+	bool compiledAllowed(const ch8Options& options) {
+		return options.enableCompiled && !options.enableExplanations && !options.enableProfiling && options.tracePath.empty() && !options.autoSpeed;
+	}
+
+	// opening random_device for every core would cost more than the rest of the constructor
+	uint32_t randomSeed() {
+		thread_local random_device seeds;
+		return seeds();
+	}
+}
+
+chip8::chip8(const ch8Options& options)
+	: longInstructions(options.platform == ch8Platform::XOCHIP)
+	, generator(randomSeed()), distChar(0, numeric_limits<uint8_t>::max())		// setup RNG
+	, enableExplanations(options.enableExplanations)
+	, enableFusion(fusionAllowed(options))
+	, enableProfiling(options.enableProfiling)
+	, enableCompiled(compiledAllowed(options))
 {
-	// setup starting RAM content
-	loadFontset();
+	if (options.platform == ch8Platform::XOCHIP) memory.setSize(MEMORY_SIZE);
 
-	// start with empty registers and stack
-	regsVx.fill(0);
-	stack.fill(0);
+	if (enableProfiling) profiler = make_unique<ch8Profiler>(kindNames());
+	if (!options.tracePath.empty()) tracer = make_unique<ch8TraceWriter>(options.tracePath);
+	if (enableExplanations) explanations.resize(DISPLAY_LAST_COUNT);
 
-	instructionsPerCycle = (speed >= STANDARD_FPS) ? (speed / STANDARD_FPS) : 1;	// if too low -> 1 instruction per frame
+	// setup starting RAM content (fontset only) and registers
+	reset({});
+}
 
-	// empty - no last instructions yet
-	lastInstructions.fill(0);
-	explanations = {"","",""};
+bool chip8::matches(const ch8Options& options) const {
+	return longInstructions == (options.platform == ch8Platform::XOCHIP) && enableExplanations == options.enableExplanations
+		&& enableFusion == fusionAllowed(options) && enableProfiling == options.enableProfiling && enableCompiled == compiledAllowed(options)
+		&& !tracer && options.tracePath.empty();
 }
 
 // load fontset to RAM
 void chip8::loadFontset() {
-	for (uint16_t i = 0; i < fontset.size(); ++i) {
-		memory.writeAtPos(FONTSET_START_ADDRESS + i, fontset[i]);
-	}
+	memory.write(FONTSET_START_ADDRESS, fontset);
+	memory.write(BIG_FONTSET_START_ADDRESS, bigFontset);
 }
 
 // attempt to load ROM from specified file path
 void chip8::loadROM(const string& fileName) {
-	ifstream file(fileName, ios::binary);
-	if (!file.good()) throw runtime_error("Couldn't load ROM file!");
+	error_code error;
+	if (!filesystem::is_regular_file(fileName, error)) throw runtime_error("Couldn't load ROM file!");		// directories report huge sizes
 
-	int fileByte = file.get();				// store initially as int -> EOF == -1
-	uint16_t position = PC_START_ADDRESS;
+	ifstream file(fileName, ios::binary | ios::ate);		// opened at the end -> position is the size
+	if (!file.good()) throw runtime_error("Couldn't load ROM file!");
 
-	// load ROM = store to RAM
-	while (file.good()) {
-		memory.writeAtPos(position, static_cast<uint8_t>(fileByte));
+	streamoff fileSize = file.tellg();
+	if (fileSize < 0) throw runtime_error("Couldn't load ROM file!");
+	if (fileSize > memory.getSize() - PC_START_ADDRESS) throw runtime_error("ROM too large for memory!");
 
-		fileByte = file.get();
-		++position;
-	}
+	// whole file in one read, then one copy to RAM
+	vector<uint8_t> rom(static_cast<size_t>(fileSize));
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(rom.data()), fileSize)) throw runtime_error("Couldn't load ROM file!");
+	reset(rom);
 }
 
-//============ Emulator execution loop ============//
+// everything but settings, listeners, profile and trace goes back to its starting value
+void chip8::reset(span<const uint8_t> rom) {
+	if (PC_START_ADDRESS + rom.size() > memory.getSize()) throw runtime_error("ROM too large for memory!");
 
-// main emulator loop
-void chip8::run() {
+	memory.clear();
+	loadFontset();
+	memory.write(PC_START_ADDRESS, rom);
+	frameBuffer = ch8FrameBuffer();
+
+	// start with empty registers and stack
 	regPC = PC_START_ADDRESS;
+	regI = 0;
+	regsVx.fill(0);
+	regDT = 0;
+	regST = 0;
+	regSP = 0;
+	stack.fill(0);
+	flagRegs.fill(0);
+	selectedPlanes = 1;
+
+	audioPattern.fill(0);
+	regPitch = DEFAULT_PITCH;
+	audioPatternLoaded = false;
+
+	keypadHeld = 0;
+	keypadPressed = 0;
+	fault = ch8Fault::NONE;
+	faultPC = 0;
+	randomDraws = 0;
+	halted = false;
+	keypadRead = false;
+	lastFrameHash = 0;
 
-	// run until user closes the window
-	while (!display.shouldClose()) {
-		
-		emulateOneFrame(instructionsPerCycle);
+	// empty - no last instructions yet
+	lastInstructions.fill(0);
+	for (string& explanation : explanations) explanation.clear();
 
-		checkForPauseInput();
+	frameCount = 0;
+	instructionCount = 0;
+	idleInstructions = 0;
+	fusionCounts.fill(0);
+	fusedInstructions.fill(0);
+	executeHeat.fill(0);
 
-	}
+	// translated code is only used for exactly the same ROM
+	compiledROM = enableCompiled ? findCompiledROM(rom, longInstructions) : nullptr;
 }
 
-void chip8::emulateOneFrame(int IPC) {
+//============ Emulator execution loop ============//
+
+ch8Fault chip8::emulateOneFrame(int IPC) {
+	if (fault != ch8Fault::NONE) return fault;		// stopped until a reset or loaded state
+	idleInstructions = 0;
+
 	// execute specified number of instructions in one cycle/frame
-	for (int i = 0; i < IPC; ++i) {
+	for (int i = 0; i < IPC; ) {
+		uint16_t address = regPC;
+
+		if (compiledROM) {
+			ch8Registers registers = getRegisters();
+			int executed = compiledROM->run(*this, registers, IPC - i);
+			if (executed == 0) {
+				interpretCompiled(registers);		// address the translator didn't find (BNNN target, code outside of the ROM)
+				executed = 1;
+			}
+			setRegisters(registers);
+			if (fault != ch8Fault::NONE) --executed;		// translated code counts the faulting instruction too
+
+			executeHeat[address >> memory.getHeatShift()] += executed;		// heatmap shows only where translated code was entered
+			instructionCount += executed;
+			i += executed;
+			if (fault != ch8Fault::NONE) return fault;
+			continue;
+		}
+
+		if (!memory.instructionFits(regPC)) {
+			raiseFault(ch8Fault::INSTRUCTION_READ);
+			return fault;
+		}
 		uint16_t instruction = memory.readInstuctionAtPos(regPC);
 
-		if (enableExplanations) updateLastInstructions(instruction);
+		int executed;
+		if (enableProfiling || tracer) {
+			executed = executeInstrumented(instruction, IPC - i);
+		}
+		else {
+			// try to execute a whole known sequence at once (counts as all of its instructions)
+			executed = enableFusion ? executeFused(instruction, IPC - i) : 0;
+			if (executed == 0) {
+				if (enableExplanations) updateLastInstructions(instruction);
 
-		executeInstruction(instruction);
+				executeInstruction(instruction);
+				if (fault != ch8Fault::NONE) return fault;		// PC stays on the faulting instruction, timers aren't lowered
+
+				regPC += INSTRUCTION_BYTES;		// increment program counter after each instruction
+				executed = 1;
+			}
+		}
 
-		regPC += INSTRUCTION_BYTES;		// increment program counter after each instruction
+		executeHeat[address >> memory.getHeatShift()] += executed;
+		instructionCount += executed;
+		i += executed;
+		if (fault != ch8Fault::NONE) return fault;		// fused sequence stopped in its middle
 	}
 
-	// lower timers each frame
+	// lower timers each frame (buzzer plays while sound timer is non-zero)
 	if (regDT != 0) --regDT;
-	if (regST != 0) {
-		--regST;
+	if (regST != 0) --regST;
+
+	++frameCount;
+	checkHalted(IPC);
+
+	// only recent activity is shown in the heatmap
+	decayHeat(executeHeat);
+	memory.decayWriteHeat();
+	return ch8Fault::NONE;
+}
+
+ch8Fault chip8::step() {
+	if (fault != ch8Fault::NONE) return fault;
 
-		// play buzzer sound
-		display.updateBuzzer();
-		if (regST == 0) display.stopBuzzer();
+	if (!memory.instructionFits(regPC)) {
+		raiseFault(ch8Fault::INSTRUCTION_READ);
+		return fault;
 	}
+	executeInstruction(memory.readInstuctionAtPos(regPC));
+	if (fault == ch8Fault::NONE) regPC += INSTRUCTION_BYTES;
+	return fault;
+}
+
+void chip8::checkHalted(int IPC) {
+	uint64_t stateHash = hashState();
+	bool jumpsToItself = regPC < 0x1000 && memory.readInstuctionAtPos(regPC) == (static_cast<uint16_t>(Opcode::JUMP) | regPC);
+	bool unchanged = IPC > 0 && stateHash == lastFrameHash && !keypadRead && regDT == 0 && regST == 0;		// frames without instructions (slow speeds) change nothing
 
-	// show new frame
-	display.update();
+	halted = jumpsToItself || unchanged;
+	lastFrameHash = stateHash;
+	keypadRead = false;
 }
 
-// enable pausing on space press and instruction advancing with enter
-void chip8::checkForPauseInput() {
-	if (GetKeyPressed() == KEY_SPACE) {
-		while (true) {
-			PollInputEvents();					// refrest pressed keys
-			int keyPressed = GetKeyPressed();
-			if (keyPressed == KEY_ENTER) {
-				emulateOneFrame(1);				// advance one instruction
-			}
-			else if (keyPressed == KEY_SPACE) {
-				break;							// resume normal operation
-			}
+// PC is still at the instruction - handlers return right after raising a fault, before changing anything
+void chip8::raiseFault(ch8Fault kind) {
+	fault = kind;
+	faultPC = regPC;
+}
+
+string chip8::describeFault() const {
+	ostringstream out;
+	out << faultMessage(fault) << " (at 0x" << hex << uppercase << setfill('0') << setw(4) << faultPC << ")";
+	return out.str();
+}
+
+// instructions the translated code doesn't do itself - drawing, keys, random numbers, memory...
+bool chip8::interpretCompiled(ch8Registers& registers) {
+	uint16_t written = registers.regI;
+	uint16_t instruction = memory.readInstuctionAtPos(registers.regPC);
+
+	setRegisters(registers);
+	step();
+	registers = getRegisters();
+	if (fault != ch8Fault::NONE) return false;		// translated code returns, emulateOneFrame reports it
+
+	// self-modifying code -> the rest of the run is interpreted
+	if (compiledROM && overlapsCompiledCode(*compiledROM, written, memoryWriteLength(instruction))) {
+		compiledROM = nullptr;
+		return false;
+	}
+	return true;
+}
+
+int chip8::memoryWriteLength(uint16_t instruction) {
+	if ((instruction & 0xF0FF) == 0xF033) return 3;
+	if ((instruction & 0xF0FF) == 0xF055) return ((instruction & 0x0F00) >> 8) + 1;
+	if ((instruction & 0xF00F) == 0x5002) return abs(((instruction & 0x0F00) >> 8) - ((instruction & 0x00F0) >> 4)) + 1;
+	return 0;
+}
+
+// translated instructions still have the bytes they were translated from (a loaded state may have overwritten them)
+bool chip8::compiledCodeIntact() const {
+	for (size_t r = 0; r < compiledROM->rangeCount; ++r) {
+		for (uint32_t address = compiledROM->codeRanges[r][0]; address <= compiledROM->codeRanges[r][1]; ++address) {
+			if (memory.readAtPos(address) != compiledROM->rom[address - PC_START_ADDRESS]) return false;
+		}
+	}
+	return true;
+}
+
+// keys are read by the frontend (on the render thread) and passed as bit masks
+void chip8::setKeypad(uint16_t held, uint16_t pressed) {
+	keypadHeld = held;
+	keypadPressed = pressed;
+}
+
+void chip8::fillSnapshot(ch8Snapshot& snapshot) const {
+	snapshot.frameBuffer = frameBuffer;
+
+	snapshot.regPC = regPC;
+	snapshot.regI = regI;
+	snapshot.regsVx = regsVx;
+	snapshot.regDT = regDT;
+	snapshot.regST = regST;
+	snapshot.regSP = regSP;
+	snapshot.stack = stack;
+	snapshot.fault = fault;
+	snapshot.faultPC = faultPC;
+
+	if (enableExplanations) {
+		snapshot.explanations = explanations;
+		snapshot.lastInstructions = lastInstructions;
+	}
+
+	snapshot.executeHeat = executeHeat;
+	snapshot.heatShift = memory.getHeatShift();
+	snapshot.writeHeat = memory.getWriteHeat();
+
+	snapshot.frame = frameCount;
+}
+
+void chip8::saveCoreState(ch8CoreState& state) const {
+	state.frameBuffer = frameBuffer;
+
+	state.registers = getRegisters();
+	state.flagRegs = flagRegs;
+	state.selectedPlanes = selectedPlanes;
+
+	state.audioPattern = audioPattern;
+	state.regPitch = regPitch;
+	state.audioPatternLoaded = audioPatternLoaded;
+
+	state.generator = generator;
+	state.randomDraws = randomDraws;
+	state.keypadHeld = keypadHeld;
+	state.keypadPressed = keypadPressed;
+
+	state.fault = fault;
+	state.faultPC = faultPC;
+}
+
+// memory has to be loaded first (checks translated code)
+void chip8::loadCoreState(const ch8CoreState& state) {
+	frameBuffer = state.frameBuffer;
+
+	setRegisters(state.registers);
+	flagRegs = state.flagRegs;
+	selectedPlanes = state.selectedPlanes;
+
+	audioPattern = state.audioPattern;
+	regPitch = state.regPitch;
+	audioPatternLoaded = state.audioPatternLoaded;
+
+	generator = state.generator;
+	randomDraws = state.randomDraws;
+	keypadHeld = state.keypadHeld;
+	keypadPressed = state.keypadPressed;
+
+	fault = state.fault;
+	faultPC = state.faultPC;
+	halted = false;
+	keypadRead = false;
+	lastFrameHash = 0;
+
+	if (compiledROM && !compiledCodeIntact()) compiledROM = nullptr;
+}
+
+void chip8::saveFork(ch8ForkState& state) const {
+	state.memory = memory.forkPages();
+	state.memoryHash = memory.getHash();
+	saveCoreState(state);
+}
+
+void chip8::loadFork(const ch8ForkState& state) {
+	if (state.memory.size() != memory.getPageCount()) throw runtime_error("Fork of a core with different memory size!");
+	memory.sharePages(state.memory, state.memoryHash);
+	loadCoreState(state);
+}
+
+uint64_t chip8::hashState() const {
+	// memory and screen keep their hashes up to date, only the small rest is hashed here
+	uint64_t value = hashWord(memory.getHash(), frameBuffer.getContentHash());
+
+	auto addBytes = [&value](const void* bytes, size_t count) {		// whole words only
+		for (size_t offset = 0; offset < count; offset += sizeof(uint64_t)) {
+			uint64_t word;
+			memcpy(&word, static_cast<const uint8_t*>(bytes) + offset, sizeof(word));
+			value = hashWord(value, word);
 		}
+	};
+	addBytes(regsVx.data(), sizeof(regsVx));
+	addBytes(stack.data(), sizeof(stack));
+	addBytes(flagRegs.data(), sizeof(flagRegs));
+	addBytes(audioPattern.data(), sizeof(audioPattern));
+
+	// the rest packed into words
+	value = hashWord(value, regPC | (static_cast<uint64_t>(regI) << 16) | (static_cast<uint64_t>(regDT) << 32) | (static_cast<uint64_t>(regST) << 40) | (static_cast<uint64_t>(regSP) << 48) | (static_cast<uint64_t>(frameBuffer.isHiRes()) << 56));
+	value = hashWord(value, selectedPlanes | (static_cast<uint64_t>(regPitch) << 8) | (static_cast<uint64_t>(audioPatternLoaded) << 16) | (static_cast<uint64_t>(fault) << 24));
+	value = hashWord(value, randomDraws);
+	return value;
+}
+
+ch8Registers chip8::getRegisters() const {
+	return ch8Registers{ regPC, regI, regsVx, regDT, regST, regSP, stack };
+}
+
+void chip8::setRegisters(const ch8Registers& registers) {
+	regPC = registers.regPC;
+	regI = registers.regI;
+	regsVx = registers.regsVx;
+	regDT = registers.regDT;
+	regST = registers.regST;
+	regSP = registers.regSP;
+	stack = registers.stack;
+}
+
+// skips over the next instruction - XO-CHIP F000 NNNN is two words long
+void chip8::skipNextInstruction() {
+	if (longInstructions && regPC + 3u < memory.getSize() && memory.readInstuctionAtPos(regPC + INSTRUCTION_BYTES) == static_cast<uint16_t>(Opcode::LOAD_LONG_ADDRESS)) {
+		regPC += 2 * INSTRUCTION_BYTES;
+	}
+	else {
+		regPC += INSTRUCTION_BYTES;
 	}
 }
 
+// handler tables - one per mask, the first one also leads to the methods for the other masks
+const unordered_map<uint16_t, chip8::InstructionHandler> chip8::opcodeHandlers = {
+	// direct handler calls
+	{static_cast<uint16_t>(Opcode::JUMP), [](chip8& core, uint16_t instruction) { core.jumpHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::CALL), [](chip8& core, uint16_t instruction) { core.callHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SKIP_IF_EQUAL), [](chip8& core, uint16_t instruction) { core.skipIfEqualHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SKIP_IF_NOT_EQUAL), [](chip8& core, uint16_t instruction) { core.skipIfNotEqualHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_IMMEDIATE), [](chip8& core, uint16_t instruction) { core.loadImmediateHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::ADD_IMMEDIATE), [](chip8& core, uint16_t instruction) { core.addImmediateHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_ADDRESS), [](chip8& core, uint16_t instruction) { core.loadAddressHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::JUMP_PLUS_V0), [](chip8& core, uint16_t instruction) { core.jumpPlusV0Handler(instruction); }},
+	{static_cast<uint16_t>(Opcode::RANDOM), [](chip8& core, uint16_t instruction) { core.randomHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::DRAW), [](chip8& core, uint16_t instruction) { core.drawHandler(instruction); }},
+
+	// method calls that mask less of the instruction
+	{0x0000, [](chip8& core, uint16_t instruction) { core.executeMatchFullInstruction(instruction); }},
+	{0x5000, [](chip8& core, uint16_t instruction) { core.executeMatchLastOneInstruction(instruction); }},
+	{0x8000, [](chip8& core, uint16_t instruction) { core.executeMatchLastOneInstruction(instruction); }},
+	{0x9000, [](chip8& core, uint16_t instruction) { core.executeMatchLastOneInstruction(instruction); }},
+	{0xE000, [](chip8& core, uint16_t instruction) { core.executeMatchLastTwoInstruction(instruction); }},
+	{0xF000, [](chip8& core, uint16_t instruction) { core.executeMatchLastTwoInstruction(instruction); }},
+};
+const unordered_map<uint16_t, void (*)(chip8&)> chip8::opcodeMatchFullHandlers = {
+	// 0x0000
+	{static_cast<uint16_t>(Opcode::CLEAR), [](chip8& core) { core.clearHandler(); }},
+	{static_cast<uint16_t>(Opcode::RETURN), [](chip8& core) { core.returnHandler(); }},
+	{static_cast<uint16_t>(Opcode::SCROLL_RIGHT), [](chip8& core) { core.scrollRightHandler(); }},
+	{static_cast<uint16_t>(Opcode::SCROLL_LEFT), [](chip8& core) { core.scrollLeftHandler(); }},
+	{static_cast<uint16_t>(Opcode::EXIT), [](chip8& core) { core.exitHandler(); }},
+	{static_cast<uint16_t>(Opcode::LOW_RES), [](chip8& core) { core.lowResHandler(); }},
+	{static_cast<uint16_t>(Opcode::HIGH_RES), [](chip8& core) { core.highResHandler(); }},
+};
+const unordered_map<uint16_t, chip8::InstructionHandler> chip8::opcodeMatchLastOneHandlers = {
+	// 0x5000
+	{static_cast<uint16_t>(Opcode::SKIP_IF_REGS_EQUAL), [](chip8& core, uint16_t instruction) { core.skipIfRegsEqualHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::STORE_RANGE), [](chip8& core, uint16_t instruction) { core.storeRangeHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_RANGE), [](chip8& core, uint16_t instruction) { core.loadRangeHandler(instruction); }},
+
+	// 0x8000
+	{static_cast<uint16_t>(Opcode::LOAD), [](chip8& core, uint16_t instruction) { core.loadHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::OR), [](chip8& core, uint16_t instruction) { core.orHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::AND), [](chip8& core, uint16_t instruction) { core.andHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::XOR), [](chip8& core, uint16_t instruction) { core.xorHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::ADD), [](chip8& core, uint16_t instruction) { core.addHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SUBTRACT), [](chip8& core, uint16_t instruction) { core.subtractHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SHIFT_RIGHT), [](chip8& core, uint16_t instruction) { core.shiftRightHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SUBTRACT_NEGATIVE), [](chip8& core, uint16_t instruction) { core.subtractNegativeHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SHIFT_LEFT), [](chip8& core, uint16_t instruction) { core.shiftLeftHandler(instruction); }},
+
+	// 0x9000
+	{static_cast<uint16_t>(Opcode::SKIP_IF_REGS_NOT_EQUAL), [](chip8& core, uint16_t instruction) { core.skipIfRegsNotEqualHandler(instruction); }},
+};
+const unordered_map<uint16_t, chip8::InstructionHandler> chip8::opcodeMatchLastTwoHandlers = {
+	// 0xE000
+	{static_cast<uint16_t>(Opcode::SKIP_IF_KEY), [](chip8& core, uint16_t instruction) { core.skipIfKeyHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SKIP_IF_NOT_KEY), [](chip8& core, uint16_t instruction) { core.skipIfNotKeyHandler(instruction); }},
+
+	// 0xF000
+	{static_cast<uint16_t>(Opcode::LOAD_DELAY), [](chip8& core, uint16_t instruction) { core.loadDelayHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_KEY), [](chip8& core, uint16_t instruction) { core.loadKeyHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SET_DELAY), [](chip8& core, uint16_t instruction) { core.setDelayHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::SET_SOUND), [](chip8& core, uint16_t instruction) { core.setSoundHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::ADD_TO_I), [](chip8& core, uint16_t instruction) { core.addToIHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_DIGIT), [](chip8& core, uint16_t instruction) { core.loadDigitHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::STORE_BCD), [](chip8& core, uint16_t instruction) { core.storeBCDHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::STORE_REGS_TO_MEMORY), [](chip8& core, uint16_t instruction) { core.storeRegsToMemoryHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_REGS_FROM_MEMORY), [](chip8& core, uint16_t instruction) { core.loadRegsFromMemoryHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_BIG_DIGIT), [](chip8& core, uint16_t instruction) { core.loadBigDigitHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::STORE_FLAGS), [](chip8& core, uint16_t instruction) { core.storeFlagsHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_FLAGS), [](chip8& core, uint16_t instruction) { core.loadFlagsHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_LONG_ADDRESS), [](chip8& core, uint16_t) { core.loadLongAddressHandler(); }},
+	{static_cast<uint16_t>(Opcode::SELECT_PLANES), [](chip8& core, uint16_t instruction) { core.selectPlanesHandler(instruction); }},
+	{static_cast<uint16_t>(Opcode::LOAD_AUDIO_PATTERN), [](chip8& core, uint16_t) { core.loadAudioPatternHandler(); }},
+	{static_cast<uint16_t>(Opcode::SET_PITCH), [](chip8& core, uint16_t instruction) { core.setPitchHandler(instruction); }},
+};
+
 // decodes and executes an instruction (based on left nibble) or calls another decoding method
 void chip8::executeInstruction(uint16_t instruction) {
 
 	// access handler function for opcode using a map and a masked instruction
 	auto it = opcodeHandlers.find(instruction & 0xF000);
 	if (it != opcodeHandlers.end()) {
-		it->second(instruction);			// call the handler function with the full instruction
+		it->second(*this, instruction);			// call the handler function with the full instruction
 	}
 	else {
-		throw runtime_error("Unknown instruction!");	// throw on any unknown opcode
+		raiseFault(ch8Fault::UNKNOWN_INSTRUCTION);		// stops the core on any unknown opcode
 	}
 }
 
 // decodes and executes an instruction (all bits must match with opcode)
 void chip8::executeMatchFullInstruction(uint16_t instruction) {
+	// 00CN and 00DN are the only ones in this group with an argument
+	if ((instruction & 0xFFF0) == static_cast<uint16_t>(Opcode::SCROLL_DOWN)) {
+		scrollDownHandler(instruction);
+		return;
+	}
+	if ((instruction & 0xFFF0) == static_cast<uint16_t>(Opcode::SCROLL_UP)) {
+		scrollUpHandler(instruction);
+		return;
+	}
+
 	auto it = opcodeMatchFullHandlers.find(instruction);
 	if (it != opcodeMatchFullHandlers.end()) {
-		it->second();						// call the handler function
+		it->second(*this);						// call the handler function
 	}
 	else {
-		throw runtime_error("Unknown instruction!");	// throw on any unknown opcode
+		raiseFault(ch8Fault::UNKNOWN_INSTRUCTION);		// stops the core on any unknown opcode
 	}
 }
 
@@ -143,10 +521,10 @@ void chip8::executeMatchFullInstruction(uint16_t instruction) {
 void chip8::executeMatchLastOneInstruction(uint16_t instruction) {
 	auto it = opcodeMatchLastOneHandlers.find(instruction & 0xF00F);
 	if (it != opcodeMatchLastOneHandlers.end()) {
-		it->second(instruction);			// call the handler function with the full instruction
+		it->second(*this, instruction);			// call the handler function with the full instruction
 	}
 	else {
-		throw runtime_error("Unknown instruction!");	// throw on any unknown opcode
+		raiseFault(ch8Fault::UNKNOWN_INSTRUCTION);		// stops the core on any unknown opcode
 	}
 }
 
@@ -154,24 +532,262 @@ void chip8::executeMatchLastOneInstruction(uint16_t instruction) {
 void chip8::executeMatchLastTwoInstruction(uint16_t instruction) {
 	auto it = opcodeMatchLastTwoHandlers.find(instruction & 0xF0FF);
 	if (it != opcodeMatchLastTwoHandlers.end()) {
-		it->second(instruction);			// call the handler function with the full instruction
+		it->second(*this, instruction);			// call the handler function with the full instruction
 	}
 	else {
-		throw runtime_error("Unknown instruction!");	// throw on any unknown opcode
+		raiseFault(ch8Fault::UNKNOWN_INSTRUCTION);		// stops the core on any unknown opcode
 	}
 }
 
 
+//============ Superinstructions (fused instruction sequences) ============//
+
+// Each fused operation gives exactly the same registers, flags and PC as executing the sequence one by one.
+// Fusions only fire when the whole sequence fits into the remaining instruction budget of the frame,
+// so timers still tick after the same number of instructions as without fusion.
+
+// checks if instruction starts a known sequence and executes it, returns number of instructions executed (0 = no fusion)
+int chip8::executeFused(uint16_t instruction, int budget) {
+	switch (instruction & 0xF000) {
+	case 0xF000:
+		if ((instruction & 0x00FF) == 0x0007) return fuseDelayWait(instruction, budget);
+		return 0;
+	case 0x6000:
+		return fuseSpriteSetup(budget);
+	case 0x7000:
+		return fuseCountedLoop(instruction, budget);
+	default:
+		return 0;
+	}
+}
+
+// reads count instructions starting at PC (without executing them), false if they would be outside of memory
+bool chip8::peekInstructions(uint16_t* instructions, int count) const {
+	if (regPC + static_cast<uint32_t>(count) * INSTRUCTION_BYTES > memory.getSize()) return false;
+
+	for (int i = 0; i < count; ++i) {
+		instructions[i] = memory.readInstuctionAtPos(regPC + i * INSTRUCTION_BYTES);
+	}
+	return true;
+}
+
+// FX07, 3XNN/4XNN, 1NNN (back to FX07) - waits for the delay timer
+// delay timer only changes at the end of the frame -> the loop either exits right away or spins for the rest of the frame
+int chip8::fuseDelayWait(uint16_t instruction, int budget) {
+	if (budget < 3) return 0;
+
+	uint16_t seq[3];
+	if (!peekInstructions(seq, 3)) return 0;
+
+	uint16_t x = (instruction & 0x0F00) >> 8;
+	bool skipEqual = (seq[1] & 0xF000) == 0x3000;
+	if ((!skipEqual && (seq[1] & 0xF000) != 0x4000) || ((seq[1] & 0x0F00) >> 8) != x) return 0;
+	if (regPC >= 0x1000 || seq[2] != (0x1000 | regPC)) return 0;		// 1NNN can't jump past 4kB, so the loop has to start below it
+
+	regsVx[x] = regDT;
+	bool skip = (regDT == (seq[1] & 0x00FF)) == skipEqual;
+
+	int executed;
+	if (skip) {
+		regPC += 3 * INSTRUCTION_BYTES;		// jump got skipped -> continue after the loop
+		executed = 2;
+	}
+	else {
+		regPC += (budget % 3) * INSTRUCTION_BYTES;		// whole iterations end at FX07 again, the rest is executed partially
+		executed = budget;
+		idleInstructions += executed;
+	}
+
+	++fusionCounts[static_cast<size_t>(Fusion::DELAY_WAIT)];
+	fusedInstructions[static_cast<size_t>(Fusion::DELAY_WAIT)] += executed;
+	return executed;
+}
+
+// 6XNN, 6YNN, ANNN, DXYN - loads sprite position and address and draws it
+int chip8::fuseSpriteSetup(int budget) {
+	if (budget < 4) return 0;
+
+	uint16_t seq[4];
+	if (!peekInstructions(seq, 4)) return 0;
+	if ((seq[1] & 0xF000) != 0x6000 || (seq[2] & 0xF000) != 0xA000 || (seq[3] & 0xF000) != 0xD000) return 0;
+
+	regsVx[(seq[0] & 0x0F00) >> 8] = seq[0] & 0x00FF;
+	regsVx[(seq[1] & 0x0F00) >> 8] = seq[1] & 0x00FF;
+	regI = seq[2] & 0x0FFF;
+	regPC += 3 * INSTRUCTION_BYTES;
+
+	drawHandler(seq[3]);
+	int executed = (fault != ch8Fault::NONE) ? 3 : 4;		// sprite outside of memory - the loads before it were done
+	if (fault == ch8Fault::NONE) regPC += INSTRUCTION_BYTES;
+
+	++fusionCounts[static_cast<size_t>(Fusion::SPRITE_SETUP)];
+	fusedInstructions[static_cast<size_t>(Fusion::SPRITE_SETUP)] += executed;
+	return executed;
+}
+
+// 7XNN, 3XNN/4XNN, 1NNN (back to 7XNN) - adds to a register until it reaches (or leaves) a value
+int chip8::fuseCountedLoop(uint16_t instruction, int budget) {
+	if (budget < 3) return 0;
+
+	uint16_t seq[3];
+	if (!peekInstructions(seq, 3)) return 0;
+
+	uint16_t x = (instruction & 0x0F00) >> 8;
+	bool skipEqual = (seq[1] & 0xF000) == 0x3000;
+	if ((!skipEqual && (seq[1] & 0xF000) != 0x4000) || ((seq[1] & 0x0F00) >> 8) != x) return 0;
+	if (regPC >= 0x1000 || seq[2] != (0x1000 | regPC)) return 0;		// 1NNN can't jump past 4kB, so the loop has to start below it
+
+	uint8_t step = instruction & 0x00FF;
+	uint8_t compared = seq[1] & 0x00FF;
+	uint8_t value = regsVx[x];
+
+	// only whole iterations are run here, an unfinished one is left to the normal execution
+	int executed = 0;
+	while (budget - executed >= 3) {
+		value += step;
+		if ((value == compared) == skipEqual) {
+			executed += 2;
+			regPC += 3 * INSTRUCTION_BYTES;		// loop ended -> continue after the jump
+			break;
+		}
+		executed += 3;
+	}
+	regsVx[x] = value;
+
+	++fusionCounts[static_cast<size_t>(Fusion::COUNTED_LOOP)];
+	fusedInstructions[static_cast<size_t>(Fusion::COUNTED_LOOP)] += executed;
+	return executed;
+}
+
+// prints how often each fusion fired and how many instructions it covered
+void chip8::printFusionStats() const {
+	cout << "Fused instruction sequences:" << endl;
+	for (size_t i = 0; i < fusionNames.size(); ++i) {
+		cout << "  " << left << setw(20) << setfill(' ') << fusionNames[i] << right
+			<< setw(12) << fusionCounts[i] << " times, " << setw(14) << fusedInstructions[i] << " instructions" << endl;
+	}
+}
+
+
+//============ Profiling ============//
+
+// executes one instruction (or fused sequence) like emulateOneFrame does, but also counts it and/or writes it to trace
+// returns number of instructions executed
+int chip8::executeInstrumented(uint16_t instruction, int budget) {
+	uint16_t address = regPC;
+	bool timed = enableProfiling && profiler->shouldSample();
+	chrono::steady_clock::time_point start;
+	if (timed) start = chrono::steady_clock::now();		// reading the clock costs more than most instructions
+	array<uint8_t, VREGS_COUNT> oldRegsVx = regsVx;
+
+	uint8_t kind;
+	int executed = enableFusion ? executeFused(instruction, budget) : 0;		// fusion is always disabled when tracing
+	if (executed != 0) {
+		// each fusion starts with a different opcode (see executeFused)
+		Fusion fusion = ((instruction & 0xF000) == 0xF000) ? Fusion::DELAY_WAIT : ((instruction & 0xF000) == 0x6000) ? Fusion::SPRITE_SETUP : Fusion::COUNTED_LOOP;
+		kind = OPCODE_COUNT + static_cast<uint8_t>(fusion);
+	}
+	else {
+		kind = decodeKind(instruction);
+		if (enableExplanations) updateLastInstructions(instruction);
+		executeInstruction(instruction);
+		if (fault != ch8Fault::NONE) return 0;		// not counted, same as without instrumentation
+		regPC += INSTRUCTION_BYTES;
+		executed = 1;
+	}
+
+	if (enableProfiling) {
+		profiler->count(address, kind);
+		if (timed) profiler->addSample(kind, chrono::steady_clock::now() - start);
+	}
+
+	if (tracer) {
+		ch8TraceRecord rec{ frameCount, address, instruction, regI, 0, regsVx, regDT, regST, regSP };
+		for (int i = 0; i < VREGS_COUNT; ++i) {
+			if (regsVx[i] != oldRegsVx[i]) rec.changedRegs |= 1 << i;
+		}
+		tracer->record(rec);
+	}
+
+	return executed;
+}
+
+// finds which opcode the instruction is (same masking as the decoding methods), uses a table for all 65536 instructions
+uint8_t chip8::decodeKind(uint16_t instruction) {
+	static const vector<uint8_t> kindTable = [] {
+		constexpr array<Opcode, OPCODE_COUNT> opcodes = {
+			Opcode::CLEAR, Opcode::RETURN, Opcode::JUMP, Opcode::CALL, Opcode::SKIP_IF_EQUAL, Opcode::SKIP_IF_NOT_EQUAL,
+			Opcode::SKIP_IF_REGS_EQUAL, Opcode::LOAD_IMMEDIATE, Opcode::ADD_IMMEDIATE, Opcode::LOAD, Opcode::OR, Opcode::AND,
+			Opcode::XOR, Opcode::ADD, Opcode::SUBTRACT, Opcode::SHIFT_RIGHT, Opcode::SUBTRACT_NEGATIVE, Opcode::SHIFT_LEFT,
+			Opcode::SKIP_IF_REGS_NOT_EQUAL, Opcode::LOAD_ADDRESS, Opcode::JUMP_PLUS_V0, Opcode::RANDOM, Opcode::DRAW,
+			Opcode::SKIP_IF_KEY, Opcode::SKIP_IF_NOT_KEY, Opcode::LOAD_DELAY, Opcode::LOAD_KEY, Opcode::SET_DELAY,
+			Opcode::SET_SOUND, Opcode::ADD_TO_I, Opcode::LOAD_DIGIT, Opcode::STORE_BCD, Opcode::STORE_REGS_TO_MEMORY,
+			Opcode::LOAD_REGS_FROM_MEMORY, Opcode::SCROLL_DOWN, Opcode::SCROLL_RIGHT, Opcode::SCROLL_LEFT, Opcode::EXIT,
+			Opcode::LOW_RES, Opcode::HIGH_RES, Opcode::LOAD_BIG_DIGIT, Opcode::STORE_FLAGS, Opcode::LOAD_FLAGS,
+			Opcode::SCROLL_UP, Opcode::STORE_RANGE, Opcode::LOAD_RANGE, Opcode::LOAD_LONG_ADDRESS, Opcode::SELECT_PLANES,
+			Opcode::LOAD_AUDIO_PATTERN, Opcode::SET_PITCH
+		};
+
+		vector<uint8_t> table(0x10000, OPCODE_COUNT + static_cast<uint8_t>(Fusion::COUNT));	// unknown by default
+		for (uint32_t instr = 0; instr < table.size(); ++instr) {
+			uint16_t mask;
+			switch (instr & 0xF000) {
+			case 0x0000:
+				mask = ((instr & 0xFFF0) == static_cast<uint16_t>(Opcode::SCROLL_DOWN) || (instr & 0xFFF0) == static_cast<uint16_t>(Opcode::SCROLL_UP)) ? 0xFFF0 : 0xFFFF;
+				break;
+			case 0x5000: case 0x8000: case 0x9000: mask = 0xF00F; break;
+			case 0xE000: case 0xF000: mask = 0xF0FF; break;
+			default: mask = 0xF000; break;
+			}
+
+			for (uint8_t kind = 0; kind < OPCODE_COUNT; ++kind) {
+				if ((instr & mask) == static_cast<uint16_t>(opcodes[kind])) table[instr] = kind;
+			}
+		}
+		return table;
+	}();
+
+	return kindTable[instruction];
+}
+
+// names of profiler kinds in the order given by decodeKind
+vector<string> chip8::kindNames() {
+	vector<string> names = {
+		"CLEAR", "RETURN", "JUMP", "CALL", "SKIP_IF_EQUAL", "SKIP_IF_NOT_EQUAL",
+		"SKIP_IF_REGS_EQUAL", "LOAD_IMMEDIATE", "ADD_IMMEDIATE", "LOAD", "OR", "AND",
+		"XOR", "ADD", "SUBTRACT", "SHIFT_RIGHT", "SUBTRACT_NEGATIVE", "SHIFT_LEFT",
+		"SKIP_IF_REGS_NOT_EQUAL", "LOAD_ADDRESS", "JUMP_PLUS_V0", "RANDOM", "DRAW",
+		"SKIP_IF_KEY", "SKIP_IF_NOT_KEY", "LOAD_DELAY", "LOAD_KEY", "SET_DELAY",
+		"SET_SOUND", "ADD_TO_I", "LOAD_DIGIT", "STORE_BCD", "STORE_REGS_TO_MEMORY",
+		"LOAD_REGS_FROM_MEMORY", "SCROLL_DOWN", "SCROLL_RIGHT", "SCROLL_LEFT", "EXIT",
+		"LOW_RES", "HIGH_RES", "LOAD_BIG_DIGIT", "STORE_FLAGS", "LOAD_FLAGS",
+		"SCROLL_UP", "STORE_RANGE", "LOAD_RANGE", "LOAD_LONG_ADDRESS", "SELECT_PLANES",
+		"LOAD_AUDIO_PATTERN", "SET_PITCH"
+	};
+	names.insert(names.end(), fusionNames.begin(), fusionNames.end());
+	names.push_back("UNKNOWN");
+	return names;
+}
+
+void chip8::printProfile() const {
+	if (profiler) profiler->report(cout, memory);		// only created with profiling enabled
+	printFusionStats();
+}
+
+
 //============ Opcode handlers ============//
 
 void chip8::clearHandler() {
-	display.clear();
+	frameBuffer.clear(selectedPlanes);
 
 	if (enableExplanations) addNewExplanation("Clear the display.");
 };
 
 void chip8::returnHandler() {
-	if (regSP == 0) throw runtime_error("Stack underflow!");
+	if (regSP == 0) {
+		raiseFault(ch8Fault::STACK_UNDERFLOW);
+		return;
+	}
 	--regSP;
 	regPC = stack[regSP];
 
@@ -179,6 +795,16 @@ void chip8::returnHandler() {
 };
 
 void chip8::jumpHandler(uint16_t instruction) {
+	uint16_t target = instruction & 0x0FFF;
+	if (target == regPC) ++idleInstructions;		// program ended by jumping to itself
+	else if (target + 2 * INSTRUCTION_BYTES == regPC) {
+		// one iteration of FX07, 3XNN/4XNN, 1NNN waiting for the delay timer (fuseDelayWait counts it when fusion is on)
+		uint16_t load = memory.readInstuctionAtPos(target);
+		uint16_t test = memory.readInstuctionAtPos(target + INSTRUCTION_BYTES);
+		bool waits = (load & 0xF0FF) == 0xF007 && ((test & 0xF000) == 0x3000 || (test & 0xF000) == 0x4000) && (test & 0x0F00) == (load & 0x0F00);
+		if (waits) idleInstructions += 3;
+	}
+
 	regPC = instruction & 0x0FFF;
 	regPC -= INSTRUCTION_BYTES;		// jump gives exact address -> this prevents increasing PC later
 
@@ -186,7 +812,10 @@ void chip8::jumpHandler(uint16_t instruction) {
 };
 
 void chip8::callHandler(uint16_t instruction) {							// stores current PC on stack
-	if (regSP == STACK_SIZE) throw runtime_error("Stack overflow!");
+	if (regSP == STACK_SIZE) {
+		raiseFault(ch8Fault::STACK_OVERFLOW);
+		return;
+	}
 
 	// some documents say stack pointer should be incremented first but that leaves first stack space empty
 	stack[regSP] = regPC;
@@ -200,7 +829,7 @@ void chip8::callHandler(uint16_t instruction) {							// stores current PC on st
 
 void chip8::skipIfEqualHandler(uint16_t instruction) {
 	if (regsVx[(instruction & 0x0F00) >> 8] == (instruction & 0x00FF)) {	// by shifting we can directly index into Vx registers
-		regPC += INSTRUCTION_BYTES;
+		skipNextInstruction();
 	}
 
 	if (enableExplanations) addNewExplanation("Skip next instruction if V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" == ") + to_string(instruction & 0x00FF));
@@ -208,7 +837,7 @@ void chip8::skipIfEqualHandler(uint16_t instruction) {
 
 void chip8::skipIfNotEqualHandler(uint16_t instruction) {
 	if (regsVx[(instruction & 0x0F00) >> 8] != (instruction & 0x00FF)) {
-		regPC += INSTRUCTION_BYTES;
+		skipNextInstruction();
 	}
 
 	if (enableExplanations) addNewExplanation("Skip next instruction if V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" != ") + to_string(instruction & 0x00FF));
@@ -216,7 +845,7 @@ void chip8::skipIfNotEqualHandler(uint16_t instruction) {
 
 void chip8::skipIfRegsEqualHandler(uint16_t instruction) {
 	if (regsVx[(instruction & 0x0F00) >> 8] == regsVx[(instruction & 0x00F0) >> 4]) {
-		regPC += INSTRUCTION_BYTES;
+		skipNextInstruction();
 	}
 
 	if (enableExplanations) addNewExplanation("Skip next instruction if V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" == V") + string(1, char_to_hex((instruction & 0x00F0) >> 4)));
@@ -325,7 +954,7 @@ void chip8::shiftLeftHandler(uint16_t instruction) {
 
 void chip8::skipIfRegsNotEqualHandler(uint16_t instruction) {
 	if (regsVx[(instruction & 0x0F00) >> 8] != regsVx[(instruction & 0x00F0) >> 4]) {
-		regPC += INSTRUCTION_BYTES;
+		skipNextInstruction();
 	}
 
 	if (enableExplanations) addNewExplanation("Skip next instruction if V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" != V") + string(1, char_to_hex((instruction & 0x00F0) >> 4)));
@@ -346,6 +975,7 @@ void chip8::jumpPlusV0Handler(uint16_t instruction) {
 
 void chip8::randomHandler(uint16_t instruction) {
 	uint8_t randomNum = static_cast<uint8_t>(distChar(generator));
+	++randomDraws;
 	regsVx[(instruction & 0x0F00) >> 8] = randomNum & (instruction & 0x00FF);
 
 	if (enableExplanations) addNewExplanation("Set V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" = random byte AND ") + to_string(instruction & 0x00FF));
@@ -353,17 +983,37 @@ void chip8::randomHandler(uint16_t instruction) {
 
 void chip8::drawHandler(uint16_t instruction) {
 	// sprite coordinates on screen
-	uint16_t xCoord = regsVx[(instruction & 0x0F00) >> 8] % VIDEO_WIDTH;
-	uint16_t yCoord = regsVx[(instruction & 0x00F0) >> 4] % VIDEO_HEIGHT;
-
-	// get sprite location in memory
-	uint16_t spriteStart = regI;
-	uint16_t spriteEnd = spriteStart + (instruction & 0x000F);
+	uint16_t xCoord = regsVx[(instruction & 0x0F00) >> 8] % frameBuffer.width();
+	uint16_t yCoord = regsVx[(instruction & 0x00F0) >> 4] % frameBuffer.height();
+
+	// every selected plane gets its own sprite, stored one after another starting at I (XO-CHIP) - all of them are read at once
+	int planeCount = popcount(static_cast<unsigned>(selectedPlanes));
+	int spriteBytes = ((instruction & 0x000F) == 0) ? BIG_SPRITE_BYTES : (instruction & 0x000F);
+	array<uint8_t, BIG_SPRITE_BYTES * MAX_PLANES> sprites;
+	if (!memory.read(regI, span<uint8_t>(sprites.data(), spriteBytes * planeCount))) {
+		raiseFault(ch8Fault::MEMORY_READ);
+		return;
+	}
 
 	bool erasedPixels = false;
-	for (uint16_t iSprite = spriteStart; iSprite < spriteEnd; ++iSprite) {		// draw all bytes of the sprite
-		uint8_t spriteByte = memory.readAtPos(iSprite);
-		erasedPixels = display.writeToBuffer(spriteByte, xCoord, yCoord + (iSprite - spriteStart)) || erasedPixels;		// tracks if pixels were erased at any point
+	const uint8_t* sprite = sprites.data();
+	for (int plane = 0; plane < MAX_PLANES; ++plane) {
+		if (!(selectedPlanes & (1 << plane))) continue;
+
+		if ((instruction & 0x000F) == 0) {
+			// DXY0 - 16x16 sprite (SUPER-CHIP), two bytes per line
+			for (uint16_t line = 0; line < 16; ++line) {
+				uint16_t spriteRow = (sprite[2 * line] << 8) | sprite[2 * line + 1];
+				erasedPixels = frameBuffer.drawSpriteRow(plane, spriteRow, xCoord, yCoord + line) || erasedPixels;
+			}
+		}
+		else {
+			for (int line = 0; line < spriteBytes; ++line) {		// draw all bytes of the sprite
+				uint16_t spriteRow = sprite[line] << 8;		// 8 pixels wide
+				erasedPixels = frameBuffer.drawSpriteRow(plane, spriteRow, xCoord, yCoord + line) || erasedPixels;		// tracks if pixels were erased at any point
+			}
+		}
+		sprite += spriteBytes;
 	}
 
 	// sets flag register to 1 if any pixels were erased
@@ -378,16 +1028,28 @@ void chip8::drawHandler(uint16_t instruction) {
 };
 
 void chip8::skipIfKeyHandler(uint16_t instruction) {
-	if (checkKeyDown(regsVx[(instruction & 0x0F00) >> 8])) {
-		regPC += INSTRUCTION_BYTES;
+	uint8_t key = regsVx[(instruction & 0x0F00) >> 8];
+	if (key >= KEYPAD_KEYS) {		// key not on keypad
+		raiseFault(ch8Fault::INVALID_KEY);
+		return;
+	}
+	keypadRead = true;
+	if (checkKeyDown(key)) {
+		skipNextInstruction();
 	}
 
 	if (enableExplanations) addNewExplanation("Skip next instruction if key with the value of V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" is pressed"));
 };
 
 void chip8::skipIfNotKeyHandler(uint16_t instruction) {
-	if (!checkKeyDown(regsVx[(instruction & 0x0F00) >> 8])) {
-		regPC += INSTRUCTION_BYTES;
+	uint8_t key = regsVx[(instruction & 0x0F00) >> 8];
+	if (key >= KEYPAD_KEYS) {		// key not on keypad
+		raiseFault(ch8Fault::INVALID_KEY);
+		return;
+	}
+	keypadRead = true;
+	if (!checkKeyDown(key)) {
+		skipNextInstruction();
 	}
 
 	if (enableExplanations) addNewExplanation("Skip next instruction if key with the value of V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" is not pressed"));
@@ -400,9 +1062,11 @@ void chip8::loadDelayHandler(uint16_t instruction) {
 };
 
 void chip8::loadKeyHandler(uint16_t instruction) {
+	keypadRead = true;
 	uint8_t pressedKey = getKeypadPressed();
 	if (pressedKey > 0x0F) {				// > 0x0F -> nothing on keypad pressed
 		regPC -= INSTRUCTION_BYTES;			// waits for key input
+		++idleInstructions;
 	}
 	else {
 		regsVx[(instruction & 0x0F00) >> 8] = pressedKey;
@@ -419,6 +1083,7 @@ void chip8::setDelayHandler(uint16_t instruction) {
 
 void chip8::setSoundHandler(uint16_t instruction) {
 	regST = regsVx[(instruction & 0x0F00) >> 8];
+	if (soundListener) soundListener(regST);
 
 	if (enableExplanations) addNewExplanation("Set sound timer to V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)));
 };
@@ -430,7 +1095,10 @@ void chip8::addToIHandler(uint16_t instruction) {
 };
 
 void chip8::loadDigitHandler(uint16_t instruction) {
-	if (regsVx[(instruction & 0x0F00) >> 8] > (FONTSET_CHAR_COUNT - 1)) throw runtime_error("Trying to access font symbol out of range!");
+	if (regsVx[(instruction & 0x0F00) >> 8] > (FONTSET_CHAR_COUNT - 1)) {
+		raiseFault(ch8Fault::FONT_OUT_OF_RANGE);
+		return;
+	}
 	regI = FONTSET_START_ADDRESS + (CHARACTER_BYTES * regsVx[(instruction & 0x0F00) >> 8]);		// move to the correct hex character
 
 	if (enableExplanations) addNewExplanation("Set I to the location of sprite for digit V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)));
@@ -440,16 +1108,19 @@ void chip8::storeBCDHandler(uint16_t instruction) {					// BCD = Binary-coded de
 	uint8_t hundreds = regsVx[(instruction & 0x0F00) >> 8] / 100;
 	uint8_t tens = (regsVx[(instruction & 0x0F00) >> 8] - (hundreds * 100)) / 10;
 	uint8_t ones = regsVx[(instruction & 0x0F00) >> 8] - ((hundreds * 100) + (tens * 10));
-	memory.writeAtPos(regI, hundreds);
-	memory.writeAtPos(regI + 1, tens);
-	memory.writeAtPos(regI + 2, ones);
+	array<uint8_t, 3> digits = { hundreds, tens, ones };
+	if (!memory.write(regI, digits)) {
+		raiseFault(ch8Fault::MEMORY_WRITE);
+		return;
+	}
 
 	if (enableExplanations) addNewExplanation("Store BCD representation of V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" in memory locations I, I+1 and I+2"));
 };
 
 void chip8::storeRegsToMemoryHandler(uint16_t instruction) {
-	for (uint16_t i = 0; i <= ((instruction & 0x0F00) >> 8); ++i) {
-		memory.writeAtPos(regI + i, regsVx[i]);
+	if (!memory.write(regI, span<const uint8_t>(regsVx.data(), ((instruction & 0x0F00) >> 8) + 1))) {
+		raiseFault(ch8Fault::MEMORY_WRITE);
+		return;
 	}
 	++regI;			// quirk - "The save and load opcodes (Fx55 and Fx65) increment the index register"
 
@@ -457,32 +1128,162 @@ void chip8::storeRegsToMemoryHandler(uint16_t instruction) {
 };
 
 void chip8::loadRegsFromMemoryHandler(uint16_t instruction) {
-	for (uint16_t i = 0; i <= ((instruction & 0x0F00) >> 8); ++i) {
-		regsVx[i] = memory.readAtPos(regI + i);
+	if (!memory.read(regI, span<uint8_t>(regsVx.data(), ((instruction & 0x0F00) >> 8) + 1))) {
+		raiseFault(ch8Fault::MEMORY_READ);
+		return;
 	}
 	++regI;		// quirk - see above
 
 	if (enableExplanations) addNewExplanation("Read registers V0 through V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" from memory starting at location I"));
 };
 
+void chip8::scrollDownHandler(uint16_t instruction) {
+	frameBuffer.scrollDown(selectedPlanes, instruction & 0x000F);
 
-//============ Keyboard input ============//
+	if (enableExplanations) addNewExplanation("Scroll display down by " + to_string(instruction & 0x000F) + " lines");
+};
 
-// uses keymap to get keyboard keys corresponding to chip-8 keypad
+void chip8::scrollRightHandler() {
+	frameBuffer.scrollRight(selectedPlanes, 4);
 
-// check if key on keypad is pressed
-bool chip8::checkKeyDown(uint8_t key) const {
-	for (uint8_t i = 0; i < KEYPAD_KEYS; ++i){
-		if (key == i) return IsKeyDown(keymap[i]);
+	if (enableExplanations) addNewExplanation("Scroll display right by 4 pixels");
+};
+
+void chip8::scrollLeftHandler() {
+	frameBuffer.scrollLeft(selectedPlanes, 4);
+
+	if (enableExplanations) addNewExplanation("Scroll display left by 4 pixels");
+};
+
+void chip8::exitHandler() {
+	regPC -= INSTRUCTION_BYTES;		// stays on this instruction forever -> program has ended
+
+	if (enableExplanations) addNewExplanation("Exit the program");
+};
+
+void chip8::lowResHandler() {
+	frameBuffer.setHiRes(false);
+
+	if (enableExplanations) addNewExplanation("Switch to low resolution (64x32)");
+};
+
+void chip8::highResHandler() {
+	frameBuffer.setHiRes(true);
+
+	if (enableExplanations) addNewExplanation("Switch to high resolution (128x64)");
+};
+
+void chip8::loadBigDigitHandler(uint16_t instruction) {
+	if (regsVx[(instruction & 0x0F00) >> 8] > (FONTSET_CHAR_COUNT - 1)) {
+		raiseFault(ch8Fault::FONT_OUT_OF_RANGE);
+		return;
+	}
+	regI = BIG_FONTSET_START_ADDRESS + (BIG_CHARACTER_BYTES * regsVx[(instruction & 0x0F00) >> 8]);
+
+	if (enableExplanations) addNewExplanation("Set I to the location of big sprite for digit V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)));
+};
+
+void chip8::storeFlagsHandler(uint16_t instruction) {
+	for (uint16_t i = 0; i <= ((instruction & 0x0F00) >> 8); ++i) {
+		flagRegs[i] = regsVx[i];
 	}
 
-	throw runtime_error("Checked status of an invalid key!");	// key not in keymap
+	if (enableExplanations) addNewExplanation("Store registers V0 through V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" in flag registers"));
+};
+
+void chip8::loadFlagsHandler(uint16_t instruction) {
+	for (uint16_t i = 0; i <= ((instruction & 0x0F00) >> 8); ++i) {
+		regsVx[i] = flagRegs[i];
+	}
+
+	if (enableExplanations) addNewExplanation("Read registers V0 through V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)) + string(" from flag registers"));
+};
+
+void chip8::scrollUpHandler(uint16_t instruction) {
+	frameBuffer.scrollUp(selectedPlanes, instruction & 0x000F);
+
+	if (enableExplanations) addNewExplanation("Scroll display up by " + to_string(instruction & 0x000F) + " lines");
+};
+
+// registers VX to VY (can go backwards), I doesn't change
+void chip8::storeRangeHandler(uint16_t instruction) {
+	int first = (instruction & 0x0F00) >> 8;
+	int last = (instruction & 0x00F0) >> 4;
+	int step = (first <= last) ? 1 : -1;
+	array<uint8_t, VREGS_COUNT> values;		// in memory order (registers can go backwards)
+	for (int i = 0; i <= abs(last - first); ++i) values[i] = regsVx[first + i * step];
+	if (!memory.write(regI, span<const uint8_t>(values.data(), abs(last - first) + 1))) {
+		raiseFault(ch8Fault::MEMORY_WRITE);
+		return;
+	}
+
+	if (enableExplanations) addNewExplanation("Store registers V" + string(1, char_to_hex(first)) + " through V" + string(1, char_to_hex(last)) + string(" in memory starting at location I"));
+};
+
+void chip8::loadRangeHandler(uint16_t instruction) {
+	int first = (instruction & 0x0F00) >> 8;
+	int last = (instruction & 0x00F0) >> 4;
+	int step = (first <= last) ? 1 : -1;
+	array<uint8_t, VREGS_COUNT> values;
+	if (!memory.read(regI, span<uint8_t>(values.data(), abs(last - first) + 1))) {
+		raiseFault(ch8Fault::MEMORY_READ);
+		return;
+	}
+	for (int i = 0; i <= abs(last - first); ++i) regsVx[first + i * step] = values[i];
+
+	if (enableExplanations) addNewExplanation("Read registers V" + string(1, char_to_hex(first)) + " through V" + string(1, char_to_hex(last)) + string(" from memory starting at location I"));
+};
+
+// address is in the next word - it is skipped afterwards
+void chip8::loadLongAddressHandler() {
+	if (!memory.instructionFits(regPC + INSTRUCTION_BYTES)) {
+		raiseFault(ch8Fault::INSTRUCTION_READ);
+		return;
+	}
+	regI = memory.readInstuctionAtPos(regPC + INSTRUCTION_BYTES);
+	regPC += INSTRUCTION_BYTES;
+
+	if (enableExplanations) addNewExplanation("Set I to the address in the next two bytes");
+};
+
+void chip8::selectPlanesHandler(uint16_t instruction) {
+	selectedPlanes = (instruction & 0x0F00) >> 8;
+
+	if (enableExplanations) addNewExplanation("Select bitplanes " + to_string((instruction & 0x0F00) >> 8) + " for drawing");
+};
+
+void chip8::loadAudioPatternHandler() {
+	if (!memory.read(regI, audioPattern)) {
+		raiseFault(ch8Fault::MEMORY_READ);
+		return;
+	}
+	audioPatternLoaded = true;
+	if (toneListener) toneListener(audioPattern, regPitch);
+
+	if (enableExplanations) addNewExplanation("Load audio pattern from memory locations I to I+15");
+};
+
+void chip8::setPitchHandler(uint16_t instruction) {
+	regPitch = regsVx[(instruction & 0x0F00) >> 8];
+	if (toneListener && audioPatternLoaded) toneListener(audioPattern, regPitch);
+
+	if (enableExplanations) addNewExplanation("Set audio pattern pitch to V" + string(1, char_to_hex((instruction & 0x0F00) >> 8)));
+};
+
+
+//============ Keyboard input ============//
+
+// keypad state is set by the frontend (see setKeypad)
+
+// check if key on keypad is pressed (key has to be on the keypad, see skipIfKeyHandler)
+bool chip8::checkKeyDown(uint8_t key) const {
+	return (keypadHeld & (1 << key)) != 0;
 }
 
-// gets (lowest) pressed key or 0xFF if nothing is pressed
+// gets (lowest) key pressed since last frame or 0xFF if nothing was pressed
 uint8_t chip8::getKeypadPressed() const {
 	for (uint8_t i = 0; i < KEYPAD_KEYS; ++i) {
-		if (IsKeyPressed(keymap[i])) return i;
+		if (keypadPressed & (1 << i)) return i;
 	}
 
 	return numeric_limits<uint8_t>::max();	// not holding any of the keypad keys
@@ -511,12 +1312,14 @@ void chip8::updateLastInstructions(uint16_t instr) {
 // overwrites printed data on subsequent calls (\r and flush)
 void chip8::printWholeMemory() const {
 	cout << "\r";
-	for (uint16_t i = 0; i < MEMORY_SIZE; i++) {
+	vector<uint8_t> content(memory.getSize());
+	memory.read(0, content);
+	for (uint32_t i = 0; i < content.size(); i++) {
 		if (i % 16 == 0) {
 			cout << setfill('0') << setw(3) << i << ": ";		// show address of current line
 		}
 
-		uint8_t readByte = memory.readAtPos(i);
+		uint8_t readByte = content[i];
 		cout << setfill('0') << setw(2) << hex << readByte << " ";		// each byte is padded to two digits
 	}
 	cout << flush;
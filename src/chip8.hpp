@@ -1,9 +1,14 @@
 #pragma once
 
 #include "memory.hpp"
-#include "display.hpp"
+#include "framebuffer.hpp"
+#include "state.hpp"
 #include "fontset.hpp"
-#include "keymap.hpp"
+#include "options.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "compiled.hpp"
+#include "fault.hpp"
 
 #include <string>
 #include <random>
@@ -12,16 +17,64 @@
 #include <vector>
 #include <unordered_map>
 #include <functional>
+#include <memory>
+#include <span>
 
 constexpr uint16_t FONTSET_START_ADDRESS = 0x000;	// might need to be 0x050, depending on game
+constexpr uint16_t BIG_FONTSET_START_ADDRESS = FONTSET_START_ADDRESS + FONTSET_CHAR_COUNT * CHARACTER_BYTES;	// right after the small font
+constexpr int FLAG_REGS_COUNT = 16;					// SUPER-CHIP "RPL user flags" (8 on the original, XO-CHIP has 16)
 constexpr uint16_t PC_START_ADDRESS = 0x200;		// 0x200 (512) - Start of most Chip-8 programs
 constexpr uint16_t INSTRUCTION_BYTES = 2;			// size of Chip-8 instruction
+constexpr int BIG_SPRITE_BYTES = 32;				// DXY0 draws 16x16 pixels (SUPER-CHIP)
 
+// registers of one core - stored outside of it while ch8Batch executes many cores at once
+struct ch8Registers {
+	uint16_t regPC;
+	uint16_t regI;
+	std::array<uint8_t, VREGS_COUNT> regsVx;
+	uint8_t regDT;
+	uint8_t regST;
+	uint8_t regSP;
+	std::array<uint16_t, STACK_SIZE> stack;
+};
+
+// everything that affects further execution except memory
+struct ch8CoreState {
+	ch8FrameBuffer frameBuffer;
+
+	ch8Registers registers;
+	std::array<uint8_t, FLAG_REGS_COUNT> flagRegs;
+	uint8_t selectedPlanes;
+
+	std::array<uint8_t, AUDIO_PATTERN_BYTES> audioPattern;
+	uint8_t regPitch;
+	bool audioPatternLoaded;
+
+	std::mt19937 generator;		// same random numbers as the original core would get
+	uint64_t randomDraws;
+	uint16_t keypadHeld;
+	uint16_t keypadPressed;
+
+	ch8Fault fault;			// a faulted state stays stopped after loading
+	uint16_t faultPC;
+};
+
+// copy of a core sharing its memory pages copy-on-write - only pages written afterwards (by either side) get copied,
+// so making one costs the rest of the state plus a pointer per page instead of the whole RAM (run-ahead, environments)
+// threads: a saved fork is only read - any number of cores on any threads may load it at the same time, and it may be
+// destroyed while they run (they keep the pages they use), but one fork must not be saved into while it's being loaded
+struct ch8ForkState : ch8CoreState {
+	pageTable memory;
+	uint64_t memoryHash;		// see ch8Memory::getHash
+};
+
+// emulator core - has no window and doesn't call raylib, so it can run on its own thread (see ch8Frontend)
 class chip8 {
 private:
-	// RAM and display
+	// RAM and screen content
 	ch8Memory memory;
-	ch8Display display;
+	ch8FrameBuffer frameBuffer;
+	heatArray executeHeat;		// recently executed instructions per address (for the heatmap view, decays every frame)
 
 	// registers
 	uint16_t regPC = 0;							// program counter register (16-bit)
@@ -32,21 +85,42 @@ private:
 	uint8_t regDT = 0;
 	uint8_t regST = 0;		// plays buzzer while non-zero
 
+	// XO-CHIP
+	bool longInstructions;			// F000 NNNN is two words long -> skips have to check the next instruction
+	uint8_t selectedPlanes = 1;		// bitplanes used by drawing, clearing and scrolling (FN01)
+
+	// XO-CHIP sound - pattern played instead of the buzzer once loaded by F002
+	std::array<uint8_t, AUDIO_PATTERN_BYTES> audioPattern;
+	uint8_t regPitch = DEFAULT_PITCH;
+	bool audioPatternLoaded = false;
+
 	// stack
 	uint8_t regSP = 0;							// stack pointer (8-bit)
 	std::array<uint16_t, STACK_SIZE> stack;		// stack - stores return address for subroutines
 
-	// random number (byte) generator
-	std::random_device rd;
+	std::array<uint8_t, FLAG_REGS_COUNT> flagRegs;		// saved and loaded by FX75 and FX85
+
+	// first fault stops the core (see fault.hpp) - handlers raise it and return, nothing throws while emulating
+	ch8Fault fault = ch8Fault::NONE;
+	uint16_t faultPC = 0;
+	void raiseFault(ch8Fault kind);
+
+	// random number (byte) generator - seeded once per thread from random_device, which is slow to create
 	std::mt19937 generator;
 	std::uniform_int_distribution<> distChar;
+	uint64_t randomDraws = 0;		// numbers taken since seeding - stands for the generator in the state hash
 
-	// default per frame (cycle) when not paused
-	int instructionsPerCycle;
+	// told about every change of sound timer by FX18 (the rest is just counting down, done by the listener itself)
+	std::function<void(uint8_t)> soundListener;
+	std::function<void(const std::array<uint8_t, AUDIO_PATTERN_BYTES>&, uint8_t)> toneListener;		// F002 and FX3A (pattern, pitch)
+
+	// keypad state given by the frontend each frame - bit n is key n
+	uint16_t keypadHeld = 0;
+	uint16_t keypadPressed = 0;		// keys pressed down since the last frame
 
 	// store past instructions and explanations
 	bool enableExplanations;
-	std::vector<std::string> explanations;
+	std::vector<std::string> explanations;		// empty with explanations disabled
 	std::array<uint16_t, DISPLAY_LAST_COUNT> lastInstructions;
 	void addNewExplanation(const std::string& expl);
 	void updateLastInstructions(uint16_t instr);
@@ -54,9 +128,48 @@ private:
 	// loads fontset into RAM - called at the start
 	void loadFontset();
 
-	// called each frame
-	void emulateOneFrame(int IPC);
-	void checkForPauseInput();			// lets user pause the game and advance one instruction at a time
+	// superinstructions - common instruction sequences executed as one operation (see executeFused)
+	enum class Fusion : uint8_t {
+		DELAY_WAIT,			// FX07, 3XNN/4XNN, 1NNN (jump back to FX07)
+		SPRITE_SETUP,		// 6XNN, 6YNN, ANNN, DXYN
+		COUNTED_LOOP,		// 7XNN, 3XNN/4XNN, 1NNN (jump back to 7XNN)
+		COUNT
+	};
+	static constexpr std::array<const char*, static_cast<size_t>(Fusion::COUNT)> fusionNames = { "FUSED_DELAY_WAIT", "FUSED_SPRITE_SETUP", "FUSED_COUNTED_LOOP" };
+	bool enableFusion;
+	bool enableProfiling;
+	std::array<uint64_t, static_cast<size_t>(Fusion::COUNT)> fusionCounts;			// how many times each fusion fired
+	std::array<uint64_t, static_cast<size_t>(Fusion::COUNT)> fusedInstructions;		// how many instructions they replaced
+	int executeFused(uint16_t instruction, int budget);
+	int fuseDelayWait(uint16_t instruction, int budget);
+	int fuseSpriteSetup(int budget);		// reads all four instructions itself
+	int fuseCountedLoop(uint16_t instruction, int budget);
+	bool peekInstructions(uint16_t* instructions, int count) const;
+	void printFusionStats() const;
+
+	// ROM translated to C++ by ch8aot (null when there is none, or when the program overwrote its own code)
+	bool enableCompiled;
+	const ch8CompiledROM* compiledROM = nullptr;
+	bool compiledCodeIntact() const;
+
+	// save states and forks without memory
+	void saveCoreState(ch8CoreState& state) const;
+	void loadCoreState(const ch8CoreState& state);
+
+	// execution counters and trace - only used when enabled (the check is the only cost otherwise)
+	std::unique_ptr<ch8Profiler> profiler;		// only exists with profiling enabled (counts of all 64k addresses are big)
+	std::unique_ptr<ch8TraceWriter> tracer;		// writes every executed instruction to a file (null when not tracing)
+	uint32_t frameCount = 0;
+	uint64_t instructionCount = 0;		// executed by emulateOneFrame (fused ones count as all of their instructions)
+	int idleInstructions = 0;			// spent waiting in the current frame - delay timer loops, jumps to itself, FX0A without a key
+
+	// halt detection (see checkHalted) - not part of save states, a loaded state needs a frame to be recognized again
+	bool halted = false;
+	bool keypadRead = false;		// in the current frame (EX9E, EXA1, FX0A)
+	uint64_t lastFrameHash = 0;		// hashState at the end of the previous frame
+	int executeInstrumented(uint16_t instruction, int budget);	// same as one step of emulateOneFrame, but profiled and/or traced
+	static uint8_t decodeKind(uint16_t instruction);			// index of opcode for the profiler (fusions and unknown instructions follow after them)
+	static std::vector<std::string> kindNames();
 
 	// all valid opcodes
 	enum class Opcode : uint16_t {
@@ -95,7 +208,27 @@ private:
 		STORE_REGS_TO_MEMORY = 0xF055,
 		LOAD_REGS_FROM_MEMORY = 0xF065,
 
+		// SUPER-CHIP
+		SCROLL_DOWN = 0x00C0,		// 00CN
+		SCROLL_RIGHT = 0x00FB,
+		SCROLL_LEFT = 0x00FC,
+		EXIT = 0x00FD,
+		LOW_RES = 0x00FE,
+		HIGH_RES = 0x00FF,
+		LOAD_BIG_DIGIT = 0xF030,
+		STORE_FLAGS = 0xF075,
+		LOAD_FLAGS = 0xF085,
+
+		// XO-CHIP
+		SCROLL_UP = 0x00D0,			// 00DN
+		STORE_RANGE = 0x5002,		// 5XY2
+		LOAD_RANGE = 0x5003,		// 5XY3
+		LOAD_LONG_ADDRESS = 0xF000,	// F000 NNNN
+		SELECT_PLANES = 0xF001,		// FN01
+		LOAD_AUDIO_PATTERN = 0xF002,
+		SET_PITCH = 0xF03A,
 	};
+	static constexpr int OPCODE_COUNT = 50;
 
 	// opcode handler methods for executing one instruction
 	void clearHandler();
@@ -132,72 +265,36 @@ private:
 	void storeBCDHandler(uint16_t instruction);
 	void storeRegsToMemoryHandler(uint16_t instruction);
 	void loadRegsFromMemoryHandler(uint16_t instruction);
+	void scrollDownHandler(uint16_t instruction);
+	void scrollRightHandler();
+	void scrollLeftHandler();
+	void exitHandler();
+	void lowResHandler();
+	void highResHandler();
+	void loadBigDigitHandler(uint16_t instruction);
+	void storeFlagsHandler(uint16_t instruction);
+	void loadFlagsHandler(uint16_t instruction);
+	void scrollUpHandler(uint16_t instruction);
+	void storeRangeHandler(uint16_t instruction);
+	void loadRangeHandler(uint16_t instruction);
+	void loadLongAddressHandler();
+	void selectPlanesHandler(uint16_t instruction);
+	void loadAudioPatternHandler();
+	void setPitchHandler(uint16_t instruction);
+
+	void skipNextInstruction();		// used by all conditional skips
 
 	// methods and maps for decoding (correct masking) one instruction and calling its handler
 	void executeInstruction(uint16_t instr);						// mask: 0xF000
 	void executeMatchFullInstruction(uint16_t instruction);			// mask: 0xFFFF
 	void executeMatchLastOneInstruction(uint16_t instruction);		// mask: 0xF00F
 	void executeMatchLastTwoInstruction(uint16_t instruction);		// mask: 0xF0FF
-	const std::unordered_map<uint16_t, std::function<void(uint16_t)>> opcodeHandlers = {		// mask: 0xF000
-		// direct handler calls
-		{static_cast<uint16_t>(Opcode::JUMP), [this](uint16_t instruction) { this->jumpHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::CALL), [this](uint16_t instruction) { this->callHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SKIP_IF_EQUAL), [this](uint16_t instruction) { this->skipIfEqualHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SKIP_IF_NOT_EQUAL), [this](uint16_t instruction) { this->skipIfNotEqualHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::LOAD_IMMEDIATE), [this](uint16_t instruction) { this->loadImmediateHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::ADD_IMMEDIATE), [this](uint16_t instruction) { this->addImmediateHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::LOAD_ADDRESS), [this](uint16_t instruction) { this->loadAddressHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::JUMP_PLUS_V0), [this](uint16_t instruction) { this->jumpPlusV0Handler(instruction); }},
-		{static_cast<uint16_t>(Opcode::RANDOM), [this](uint16_t instruction) { this->randomHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::DRAW), [this](uint16_t instruction) { this->drawHandler(instruction); }},
-
-		// method calls that mask less of the instruction
-		{0x0000, [this](uint16_t instruction) { this->executeMatchFullInstruction(instruction); }},
-		{0x5000, [this](uint16_t instruction) { this->executeMatchLastOneInstruction(instruction); }},
-		{0x8000, [this](uint16_t instruction) { this->executeMatchLastOneInstruction(instruction); }},
-		{0x9000, [this](uint16_t instruction) { this->executeMatchLastOneInstruction(instruction); }},
-		{0xE000, [this](uint16_t instruction) { this->executeMatchLastTwoInstruction(instruction); }},
-		{0xF000, [this](uint16_t instruction) { this->executeMatchLastTwoInstruction(instruction); }},
-	};
-	const std::unordered_map<uint16_t, std::function<void()>> opcodeMatchFullHandlers = {		// mask: 0xFFFF
-		// 0x0000
-		{static_cast<uint16_t>(Opcode::CLEAR), [this]() { this->clearHandler(); }},
-		{static_cast<uint16_t>(Opcode::RETURN), [this]() { this->returnHandler(); }},
-	};
-	const std::unordered_map<uint16_t, std::function<void(uint16_t)>> opcodeMatchLastOneHandlers = {		// mask: 0xF00F
-		// 0x5000
-		{static_cast<uint16_t>(Opcode::SKIP_IF_REGS_EQUAL), [this](uint16_t instruction) { this->skipIfRegsEqualHandler(instruction); }},
-
-		// 0x8000
-		{static_cast<uint16_t>(Opcode::LOAD), [this](uint16_t instruction) { this->loadHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::OR), [this](uint16_t instruction) { this->orHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::AND), [this](uint16_t instruction) { this->andHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::XOR), [this](uint16_t instruction) { this->xorHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::ADD), [this](uint16_t instruction) { this->addHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SUBTRACT), [this](uint16_t instruction) { this->subtractHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SHIFT_RIGHT), [this](uint16_t instruction) { this->shiftRightHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SUBTRACT_NEGATIVE), [this](uint16_t instruction) { this->subtractNegativeHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SHIFT_LEFT), [this](uint16_t instruction) { this->shiftLeftHandler(instruction); }},
-
-		// 0x9000
-		{static_cast<uint16_t>(Opcode::SKIP_IF_REGS_NOT_EQUAL), [this](uint16_t instruction) { this->skipIfRegsNotEqualHandler(instruction); }},
-	};
-	const std::unordered_map<uint16_t, std::function<void(uint16_t)>> opcodeMatchLastTwoHandlers = {		// mask: 0xF0FF
-		// 0xE000
-		{static_cast<uint16_t>(Opcode::SKIP_IF_KEY), [this](uint16_t instruction) { this->skipIfKeyHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SKIP_IF_NOT_KEY), [this](uint16_t instruction) { this->skipIfNotKeyHandler(instruction); }},
-
-		// 0xF000
-		{static_cast<uint16_t>(Opcode::LOAD_DELAY), [this](uint16_t instruction) { this->loadDelayHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::LOAD_KEY), [this](uint16_t instruction) { this->loadKeyHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SET_DELAY), [this](uint16_t instruction) { this->setDelayHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::SET_SOUND), [this](uint16_t instruction) { this->setSoundHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::ADD_TO_I), [this](uint16_t instruction) { this->addToIHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::LOAD_DIGIT), [this](uint16_t instruction) { this->loadDigitHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::STORE_BCD), [this](uint16_t instruction) { this->storeBCDHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::STORE_REGS_TO_MEMORY), [this](uint16_t instruction) { this->storeRegsToMemoryHandler(instruction); }},
-		{static_cast<uint16_t>(Opcode::LOAD_REGS_FROM_MEMORY), [this](uint16_t instruction) { this->loadRegsFromMemoryHandler(instruction); }},
-	};
+	// shared by all cores (built once, not per instance) - handlers get the core they run on
+	using InstructionHandler = void (*)(chip8& core, uint16_t instruction);
+	static const std::unordered_map<uint16_t, InstructionHandler> opcodeHandlers;				// mask: 0xF000
+	static const std::unordered_map<uint16_t, void (*)(chip8& core)> opcodeMatchFullHandlers;	// mask: 0xFFFF
+	static const std::unordered_map<uint16_t, InstructionHandler> opcodeMatchLastOneHandlers;	// mask: 0xF00F
+	static const std::unordered_map<uint16_t, InstructionHandler> opcodeMatchLastTwoHandlers;	// mask: 0xF0FF
 
 	// keyboard input
 	bool checkKeyDown(uint8_t key) const;
@@ -207,9 +304,60 @@ private:
 	void printWholeMemory() const;
 
 public:
-	chip8(int scale, int speed, bool enableExplanations, unsigned int mainColor, unsigned int BGColor);
-	void loadROM(const std::string& fileName);
-	void run();		// begins executing instructions
+	chip8(const ch8Options& options);
+	void loadROM(const std::string& fileName);		// reads the file and resets the core with it
+
+	// puts the core into the state of a newly created one with the ROM loaded - settings from the constructor stay,
+	// so one core can run many ROMs (see ch8CorePool), the random generator has to be seeded again
+	void reset(std::span<const uint8_t> rom);
+	bool matches(const ch8Options& options) const;		// constructed with the same settings
+
+	// executes IPC instructions, then lowers timers - called 60 times per second
+	// returns the fault which stopped the core (the frame ends right at it, timers aren't lowered), NONE otherwise
+	ch8Fault emulateOneFrame(int IPC);
+	void setKeypad(uint16_t held, uint16_t pressed);
+	void setSoundListener(std::function<void(uint8_t)> listener) { soundListener = std::move(listener); }
+	void setToneListener(std::function<void(const std::array<uint8_t, AUDIO_PATTERN_BYTES>&, uint8_t)> listener) { toneListener = std::move(listener); }
+
+	// copies everything shown by the display
+	void fillSnapshot(ch8Snapshot& snapshot) const;
+	ch8FrameBuffer const& getFrameBuffer() const { return frameBuffer; }
+	uint64_t getInstructionCount() const { return instructionCount; }
+	int getIdleInstructions() const { return idleInstructions; }		// of the last frame (see ch8SpeedTuner)
+	ch8Fault getFault() const { return fault; }
+	bool isHalted() const { return halted; }		// as of the end of the last frame
+	uint16_t getFaultPC() const { return faultPC; }
+	std::string describeFault() const;		// message with the address of the instruction
+
+	// save states - statistics, heatmap and trace are not part of them
+	void saveFork(ch8ForkState& state) const;
+	void loadFork(const ch8ForkState& state);		// needs a core with the same memory size
+
+	// single instructions for ch8Batch - no superinstructions, profiling, trace or explanations, timers aren't lowered
+	ch8Fault step();
+
+	// end of a frame of IPC instructions (emulateOneFrame does it, ch8Batch after lowering the timers) - the program halted when
+	// it jumps to itself, or the frame ended in exactly the same state as the previous one without reading the keypad and with
+	// both timers at zero, so neither keys nor time can change anything any more
+	void checkHalted(int IPC);
+	ch8Registers getRegisters() const;
+	void setRegisters(const ch8Registers& registers);
+	uint16_t peekInstruction(uint16_t address) const { return memory.readInstuctionAtPos(address); }		// 0 outside of memory
+	uint8_t peekMemory(uint16_t address) const { return memory.readAtPos(address); }		// for reward functions (see ch8Environment)
+	uint32_t getMemorySize() const { return memory.getSize(); }
+	void seedRandom(uint32_t seed) { generator.seed(seed); randomDraws = 0; }
+
+	// O(1) hash of everything in a save state except the keypad (it's input, set before every frame) - tells states apart for search
+	// and determinism checks, the random generator counts by the numbers taken from it, so only states from the same seed compare
+	uint64_t hashState() const;
+
+	// executes the instruction at registers.regPC for translated code - false when it overwrote translated instructions
+	// or faulted (the translated code has to return then)
+	bool interpretCompiled(ch8Registers& registers);
+	bool isCompiled() const { return compiledROM != nullptr; }
+	static int memoryWriteLength(uint16_t instruction);		// bytes written from I by FX33, FX55 and 5XY2 (0 for other instructions)
+
+	void printProfile() const;
 };
 
 
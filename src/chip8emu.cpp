@@ -2,10 +2,16 @@
 #include "raylib.h"
 
 #include "chip8emu.hpp"
-#include "chip8.hpp"
+#include "compiled.hpp"
+#include "frontend.hpp"
+#include "romdb.hpp"
+#include "runner.hpp"
 
+#include <iomanip>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -15,37 +21,115 @@ int main(int argc, char** argv)
 
     //============ Parse args ============//
 
+    // separate --flags (allowed anywhere) from positional options
+    ch8Options options;
+    vector<char*> args;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) args.push_back(argv[i]);
+        else if (arg == "--no-fusion") options.enableFusion = false;
+        else if (arg == "--no-aot") options.enableCompiled = false;
+        else if (arg == "--profile") options.enableProfiling = true;
+        else if (arg.rfind("--trace=", 0) == 0) options.tracePath = arg.substr(8);
+        else if (arg.rfind("--fps=", 0) == 0 && isNumber(argv[i] + 6)) options.renderFPS = stoi(arg.substr(6));
+        else if (arg == "--latency") options.measureLatency = true;
+        else if (arg == "--platform=chip8") { options.platform = ch8Platform::CHIP8; options.platformGiven = true; }
+        else if (arg == "--platform=schip") { options.platform = ch8Platform::SCHIP; options.platformGiven = true; }
+        else if (arg == "--platform=xochip") { options.platform = ch8Platform::XOCHIP; options.platformGiven = true; }
+        else if (arg == "--keymap=default") { options.keymap = ch8Keymap::DEFAULT; options.keymapGiven = true; }
+        else if (arg == "--keymap=arrows") { options.keymap = ch8Keymap::ARROWS; options.keymapGiven = true; }
+        else if (arg.rfind("--romdb=", 0) == 0) options.romDatabasePath = arg.substr(8);
+        else if (arg.rfind("--runahead=", 0) == 0 && isNumber(argv[i] + 11)) options.runAhead = stoi(arg.substr(11));
+        else if (arg == "--headless") options.headless = true;
+        else if (arg == "--auto-speed") options.autoSpeed = true;
+        else if (arg.rfind("--speed=", 0) == 0 && isNumber(argv[i] + 8)) { options.speed = stoi(arg.substr(8)); options.speedGiven = true; }
+        else if (arg.rfind("--frames=", 0) == 0 && isNumber(argv[i] + 9)) options.frames = stoi(arg.substr(9));
+        else if (arg.rfind("--max-instructions=", 0) == 0 && isNumber(argv[i] + 19, 18)) options.maxInstructions = stoull(arg.substr(19));
+        else if (arg == "--no-halt") options.stopOnHalt = false;
+        else if (arg == "--require-halt") options.requireHalt = true;
+        else if (arg.rfind("--input=", 0) == 0) options.inputPath = arg.substr(8);
+        else if (arg.rfind("--threads=", 0) == 0 && isNumber(argv[i] + 10)) options.threads = stoi(arg.substr(10));
+        else if (arg.rfind("--seed=", 0) == 0 && isNumber(argv[i] + 7)) options.seed = stoul(arg.substr(7));
+        else if (arg.rfind("--batch=", 0) == 0 && isNumber(argv[i] + 8, 4)) options.batchLanes = stoi(arg.substr(8));
+        else cout << "Ignoring unknown or invalid option " << arg << endl;
+    }
+
     // display help message when no ROM file path is provided
-    if (argc < 2) {
-        cout << "Usage: chip8emu filepath [scale] [instr/sec] [explanations] [color] [BGcolor]" << endl;
+    if (args.empty()) {
+        cout << "Usage: chip8emu filepath [scale] [instr/sec] [explanations] [color] [BGcolor] [--flags]" << endl;
+        cout << "       chip8emu --headless filepaths/directories... [--flags]" << endl;
         cout << "(default: scale = 16, instr/sec = 840, explanations = false, color = ffcc01, BGcolor = 996700)" << endl;
+        cout << "Flags: --no-fusion (execute instruction sequences one by one), --profile (print execution statistics on exit)," << endl;
+        cout << "       --trace=file (write every executed instruction to a binary trace, convert it to text with ch8trace)," << endl;
+        cout << "       --fps=N (limit rendering to N frames per second, default is the monitor refresh rate), --latency (measure keypress to screen time)," << endl;
+        cout << "       --runahead=N (show the screen N frames ahead to hide input lag of games)," << endl;
+        cout << "       --platform=chip8|schip|xochip (variant the ROM was made for, xochip enables 64kB memory)," << endl;
+        cout << "       --no-aot (interpret ROMs even when they were translated by ch8aot and linked in), --keymap=default|arrows (keyboard layout)," << endl;
+        cout << "       --romdb=file (platform, speed and keymap of known ROMs, default romdb.txt, empty to ignore it)," << endl;
+        cout << "       --auto-speed (adjust speed to the game while it runs, default for unknown ROMs without instr/sec)" << endl;
+        cout << "Headless: --speed=N (instr/sec), --frames=N (frames per run, default 600), --input=file (input script for every ROM)," << endl;
+        cout << "       --threads=N (default is one per hardware thread), --seed=N (seed of random numbers, default 0)," << endl;
+        cout << "       --max-instructions=N (end runs after N instructions too), --no-halt (run all frames even after the ROM halted)," << endl;
+        cout << "       --require-halt (runs which don't halt before the frame or instruction limit fail)," << endl;
+        cout << "       --batch=N (run every ROM on N lanes of the batched core and check them against N separate cores)" << endl;
         return 1;
     }
 
+    //============ Run headless ============//
+
+    // every positional argument is a ROM or a directory with ROMs
+    if (options.headless) {
+        try {
+            return runHeadless(options, vector<string>(args.begin(), args.end()));
+        }
+        catch (const std::runtime_error& error) {
+            cout << "Exception occured: " << error.what() << endl;
+            return 1;
+        }
+    }
+
     // get option values if provided, fallback to default on incorrect format
 
-    int scale = 16;     // modifies size of the window
-    if (argc >= 3 && isNumber(argv[2])) scale = stoi(argv[2]);
+    if (args.size() >= 2 && isNumber(args[1])) options.scale = stoi(args[1]);      // modifies size of the window
 
-    int speed = 840;    // instructions per second
-	if (argc >= 4 && isNumber(argv[3])) speed = stoi(argv[3]);
+    if (args.size() >= 3 && isNumber(args[2])) {
+        options.speed = stoi(args[2]);      // instructions per second
+        options.speedGiven = true;
+    }
 
-    bool enableExplanations = false;    // show instruction explanations at the bottom
-    if (argc >= 5 && string(argv[4]) == "true") enableExplanations = true;
+    if (args.size() >= 4 && string(args[3]) == "true") options.enableExplanations = true;     // show instruction explanations at the bottom
 
-    unsigned int mainColor = 0xffcc01FF;    // color of displayed pixels
-    if (argc >= 6 && isHexColor(argv[5])) mainColor = (stoul(argv[5], nullptr, 16) << 8) | 0xFF;   // converts string of hex digits to number, then appends full alpha channel (0xFF)
+    if (args.size() >= 5 && isHexColor(args[4])) options.mainColor = (stoul(args[4], nullptr, 16) << 8) | 0xFF;   // converts string of hex digits to number, then appends full alpha channel (0xFF)
 
-    unsigned int BGColor = 0x996700FF;      // color of background pixels
-    if (argc >= 7 && isHexColor(argv[6])) BGColor = (stoul(argv[6], nullptr, 16) << 8) | 0xFF;     // see above
+    if (args.size() >= 6 && isHexColor(args[5])) options.BGColor = (stoul(args[5], nullptr, 16) << 8) | 0xFF;     // see above
 
 
     //============ Run emulator ============//
 
     try {
-        chip8 CHIP(scale, speed, enableExplanations, mainColor, BGColor);
-        CHIP.loadROM(argv[1]);
-        CHIP.run();
+        // known ROMs get their platform, speed and keymap from the database (unless they were given above)
+        ch8RomDatabase database(options.romDatabasePath);
+        const ch8RomInfo* info = database.apply(args[0], options);
+        if (info) {
+            cout << "Known ROM " << info->name << " - running at " << options.speed << " instr/sec" << endl;
+        }
+        else {
+            cout << "ROM hash " << hex << setfill('0') << setw(16) << hashROMFile(args[0]) << dec << " is not in the ROM database" << endl;
+        }
+
+        // speed of unknown games is found while they run - except translated ones, translated code doesn't count waiting (see ch8SpeedTuner)
+        bool translated = options.enableCompiled && findCompiledROMFile(args[0], options.platform == ch8Platform::XOCHIP);
+        if (options.autoSpeed && translated) {
+            cout << "Automatic speed needs the interpreter - translated code of this ROM isn't used" << endl;
+        }
+        else if (!options.speedGiven && !(info && info->speed > 0)) {
+            if (translated) cout << "ROM was translated ahead of time - running at " << options.speed << " instr/sec (--auto-speed interprets it instead)" << endl;
+            else options.autoSpeed = true;
+        }
+
+        ch8Frontend emulator(options);
+        emulator.loadROM(args[0]);
+        emulator.run();
     }
     catch (const std::runtime_error& error) {
         cout << "Exception occured: " << error.what() << endl;
@@ -55,15 +139,16 @@ int main(int argc, char** argv)
     return 0;
 }
 
-// checks if all character all digits
-bool isNumber(char* strNum) {
-
+// checks if all character all digits and there is at least one (at most maxDigits, so the conversion can't overflow)
+bool isNumber(char* strNum, int maxDigits) {
+    int digits = 0;
     while (*strNum) {
         if (!isdigit(*strNum)) return false;
         strNum++;
+        ++digits;
     }
 
-    return true;
+    return digits > 0 && digits <= maxDigits;
 }
 
 
@@ -1,5 +1,5 @@
 ﻿#pragma once
 
-bool isNumber(char* strNum);
+bool isNumber(char* strNum, int maxDigits = 9);		// 9 digits always fit into an int
 
 bool isHexColor(char* strNum);
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "compiled.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using namespace std;
+
+namespace {
+	// filled by static initializers of generated sources, only read afterwards
+	vector<const ch8CompiledROM*>& registry() {
+		static vector<const ch8CompiledROM*> compiledROMs;
+		return compiledROMs;
+	}
+}
+
+void registerCompiledROM(const ch8CompiledROM& compiled) {
+	registry().push_back(&compiled);
+}
+
+const ch8CompiledROM* findCompiledROM(span<const uint8_t> rom, bool longInstructions) {
+	for (const ch8CompiledROM* compiled : registry()) {
+		if (compiled->longInstructions == longInstructions && compiled->romSize == rom.size() && equal(rom.begin(), rom.end(), compiled->rom)) return compiled;
+	}
+	return nullptr;
+}
+
+const ch8CompiledROM* findCompiledROMFile(const string& romPath, bool longInstructions) {
+	if (registry().empty()) return nullptr;		// nothing to read the file for
+
+	ifstream file(romPath, ios::binary);
+	if (!file.good()) return nullptr;		// loading the ROM reports it
+	vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	return findCompiledROM(rom, longInstructions);
+}
+
+bool overlapsCompiledCode(const ch8CompiledROM& compiled, uint16_t address, int length) {
+	for (int i = 0; i < length; ++i) {
+		uint16_t written = static_cast<uint16_t>(address + i);
+		for (size_t r = 0; r < compiled.rangeCount; ++r) {
+			if (written >= compiled.codeRanges[r][0] && written <= compiled.codeRanges[r][1]) return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+class chip8;
+struct ch8Registers;
+
+// ROM translated to C++ ahead of time by ch8aot - executes up to budget instructions on the registers,
+// returns how many it executed (0 = PC isn't at an address the translator found, the interpreter has to run it)
+using ch8CompiledCode = int (*)(chip8& core, ch8Registers& registers, int budget);
+
+// one translated ROM - generated sources register it when the program starts
+struct ch8CompiledROM {
+	const char* name;
+	const uint8_t* rom;					// original ROM - used only when the loaded one is exactly the same
+	size_t romSize;
+	bool longInstructions;				// translated for XO-CHIP (skips over F000 NNNN)
+	const uint16_t (*codeRanges)[2];	// first and last address of translated instructions, sorted
+	size_t rangeCount;
+	ch8CompiledCode run;
+};
+
+void registerCompiledROM(const ch8CompiledROM& compiled);
+const ch8CompiledROM* findCompiledROM(std::span<const uint8_t> rom, bool longInstructions);
+const ch8CompiledROM* findCompiledROMFile(const std::string& romPath, bool longInstructions);		// null for unreadable files too
+
+// true when any of the written bytes belongs to a translated instruction (the translation isn't valid anymore)
+bool overlapsCompiledCode(const ch8CompiledROM& compiled, uint16_t address, int length);
+
+// generated sources create one of these as a global
+struct ch8CompiledRegistration {
+	explicit ch8CompiledRegistration(const ch8CompiledROM& compiled) { registerCompiledROM(compiled); }
+};
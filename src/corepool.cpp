@@ -0,0 +1,27 @@
+#include "corepool.hpp"
+
+using namespace std;
+
+unique_ptr<chip8> ch8CorePool::acquire(const ch8Options& options) {
+	unique_ptr<chip8> core;
+	{
+		lock_guard<mutex> guard(lock);
+		for (auto it = idle.rbegin(); it != idle.rend(); ++it) {		// most recently used is the most likely to be in cache
+			if (!(*it)->matches(options)) continue;
+
+			core = move(*it);
+			idle.erase(next(it).base());
+			break;
+		}
+		if (!core) ++created;
+	}
+
+	if (!core) return make_unique<chip8>(options);		// too big for the stack of a worker thread
+	core->reset({});		// same as a new core even when loading the next ROM fails
+	return core;
+}
+
+void ch8CorePool::release(unique_ptr<chip8> core) {
+	lock_guard<mutex> guard(lock);
+	idle.push_back(move(core));
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "chip8.hpp"
+#include "options.hpp"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// cores that finished a run, handed out again instead of creating new ones (headless runs, many short jobs)
+// a reused core is only reset with the next ROM (chip8::reset), it keeps the settings it was created with
+class ch8CorePool {
+private:
+	std::mutex lock;
+	std::vector<std::unique_ptr<chip8>> idle;
+	size_t created = 0;
+
+public:
+	// idle core created with the same settings (reset to an empty memory), otherwise a new one
+	std::unique_ptr<chip8> acquire(const ch8Options& options);
+	void release(std::unique_ptr<chip8> core);
+
+	size_t getCreated() const { return created; }		// cores made by the pool so far
+};
@@ -3,42 +3,38 @@
 
 #include <sstream>
 #include <iomanip>		// enables setfill() and setw() to pad numbers with zeros
-#include <filesystem>
-#include <iostream>
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 
-ch8Display::ch8Display(int SF, int speed, uint16_t const& regPC, uint16_t const& regI, array<uint8_t, VREGS_COUNT> const& regsVx
-, uint8_t const& regDT, uint8_t const& regST, uint8_t const& regSP , array<uint16_t, STACK_SIZE> const& stack
-, std::vector<std::string> const& explanations, std::array<uint16_t, DISPLAY_LAST_COUNT> const& lastInstructions, bool enableExplanations
-, unsigned int mainColor, unsigned int BGColor)
-	: scaleFactor(SF), window(screenWidth, screenHeight - (enableExplanations ? 0 : scaleFactor * EXPLANATIONS_HEIGHT), "CHIP-8 Emulator"),	// make window smaller if explanations are disabled
-	regPC_(regPC), regI_(regI), regsVx_(regsVx), regDT_(regDT), regST_(regST), regSP_(regSP), stack_(stack),
-	explanations_(explanations), lastInstructions_(lastInstructions), enableExplanations_(enableExplanations),
-	contentColor(mainColor), backgroundColor(BGColor)
+ch8Display::ch8Display(int SF, int renderFPS, bool enableExplanations, unsigned int mainColor, unsigned int BGColor)
+	: scaleFactor(SF), window(screenWidth, screenHeight - (enableExplanations ? 0 : scaleFactor * EXPLANATIONS_HEIGHT), "CHIP-8 Emulator",	// make window smaller if explanations are disabled
+		(renderFPS == 0) ? FLAG_VSYNC_HINT : 0),		// without a limit present once per monitor refresh (also on 120/144 Hz monitors)
+	enableExplanations_(enableExplanations),
+	contentColor(mainColor), backgroundColor(BGColor),
+	palette{ backgroundColor, contentColor, Color{ 0xFF, 0x66, 0x00, 0xFF }, Color{ 0x66, 0x22, 0x00, 0xFF },		// XO-CHIP colors for 2 planes
+		DARKBLUE, BLUE, SKYBLUE, DARKGREEN, GREEN, LIME, DARKPURPLE, PURPLE, VIOLET, MAROON, RED, WHITE }
 {
-
-	frameBuffer.fill(0);		// initialize as blank screen
-	window.SetTargetFPS(speed);
+	window.SetTargetFPS(renderFPS);		// rendering isn't tied to the 60 Hz emulation - newest frame is shown as soon as possible
 	
 	// draw and set window icon (in taskbar and such)
 	raylib::Image icon(ICON_SIZE, ICON_SIZE, contentColor);
 	icon.DrawText("8", ICON_SIZE/4, ICON_SIZE / 16, ICON_SIZE, BLACK);
 	window.SetIcon(icon);
 
-	// load buzzer if possible or print error
-	const string buzzerPath = "buzzer.wav";
-	if (filesystem::exists(buzzerPath)) {
-		buzzer.Load(buzzerPath);
-		buzzerLoaded = true;
-	}
-	else {
-		buzzerLoaded = false;
-		cout << "Failed to load buzzer sound file. Please make sure buzzer.wav exists." << endl;
-	}
+	// texture has room for high resolution, low resolution only uses its top left part
+	screenPixels.fill(backgroundColor);
+	screenTexture.Load(raylib::Image(HIRES_WIDTH, HIRES_HEIGHT, backgroundColor));
+
+	// heatmap is uploaded to this texture every frame (when shown)
+	heatmapPixels.fill(BLACK);
+	heatmapTexture.Load(raylib::Image(HEATMAP_SIZE, HEATMAP_SIZE, BLACK));
 }
 
 ch8Display::~ch8Display() noexcept {
+	screenTexture.Unload();		// textures need the window (OpenGL context) to still exist
+	heatmapTexture.Unload();
 	window.Close();
 }
 
@@ -50,104 +46,107 @@ bool ch8Display::shouldClose() const {
 
 //============ Drawing new frame ============//
 
-void ch8Display::update() {
+void ch8Display::update(const ch8Snapshot& snapshot) {
 	window.BeginDrawing();
 
 	window.ClearBackground(BLACK);
-	drawScreen();	
-	drawMemory();
-	if (enableExplanations_) drawInstructions();
+	drawScreen(snapshot);
+	drawMemory(snapshot);
+	if (showHeatmap) drawHeatmap(snapshot);
+	if (enableExplanations_) drawInstructions(snapshot);
+	if (snapshot.fault != ch8Fault::NONE) drawFault(snapshot);
 
 	window.EndDrawing();
 }
 
-// draw rectangle for each pixel of the game screen
-void ch8Display::drawScreen() const {
-	for (int y = 0; y < VIDEO_HEIGHT; ++y) {
-		for (int x = 0; x < VIDEO_WIDTH; ++x) {
-
-			// pick color according to frame buffer (0 = background pixel)
-			// it stores pixels as bits in bytes so shifting is needed
-			Color pixelColor = (frameBuffer[(y * VIDEO_LINE_BYTES) + (x / 8)] & (128 >> (x % 8))) ? contentColor : backgroundColor;
-
-			DrawRectangle(x * scaleFactor, y * scaleFactor, scaleFactor, scaleFactor, pixelColor);
+// combine bitplanes to colors and draw them as one scaled texture (high resolution pixels are half the size)
+void ch8Display::drawScreen(const ch8Snapshot& snapshot) {
+	const ch8FrameBuffer& frameBuffer = snapshot.frameBuffer;
+	int width = frameBuffer.width();
+	int height = frameBuffer.height();
+
+	for (int y = 0; y < height; ++y) {
+		Color* pixelRow = &screenPixels[y * HIRES_WIDTH];
+		for (int word = 0; word < width / 64; ++word) {
+			std::array<uint64_t, MAX_PLANES> planeWords;
+			for (int p = 0; p < MAX_PLANES; ++p) planeWords[p] = frameBuffer.getWord(p, y, word);
+
+			for (int bit = 0; bit < 64; ++bit) {
+				// bit from every plane gives index to the palette (no planes set = background pixel)
+				int colorIndex = 0;
+				for (int p = 0; p < MAX_PLANES; ++p) colorIndex |= ((planeWords[p] >> (63 - bit)) & 1) << p;
+
+				pixelRow[word * 64 + bit] = palette[colorIndex];
+			}
 		}
 	}
+
+	screenTexture.Update(screenPixels.data());
+	screenTexture.Draw(raylib::Rectangle(0, 0, static_cast<float>(width), static_cast<float>(height)),
+		raylib::Rectangle(0, 0, static_cast<float>(scaleFactor * VIDEO_WIDTH), static_cast<float>(scaleFactor * VIDEO_HEIGHT)));
 }
 
 // draw registers and stack display to the right
-void ch8Display::drawMemory() const {
-	DrawText(("PC: " + to_string(regPC_)).c_str(), scaleFactor * (VIDEO_WIDTH + 5), scaleFactor * 1, static_cast<int>(scaleFactor * 1.5), WHITE);
-	DrawText(("I: " + to_string(regI_)).c_str(), scaleFactor * (VIDEO_WIDTH + 2), scaleFactor * 3, static_cast<int>(scaleFactor * 1.5), PURPLE);
-	DrawText(("SP: " + to_string(regSP_)).c_str(), scaleFactor * (VIDEO_WIDTH + 2), scaleFactor * 5, static_cast<int>(scaleFactor * 1.5), BLUE);
+void ch8Display::drawMemory(const ch8Snapshot& snapshot) const {
+	DrawText(("PC: " + to_string(snapshot.regPC)).c_str(), scaleFactor * (VIDEO_WIDTH + 5), scaleFactor * 1, static_cast<int>(scaleFactor * 1.5), WHITE);
+	DrawText(("I: " + to_string(snapshot.regI)).c_str(), scaleFactor * (VIDEO_WIDTH + 2), scaleFactor * 3, static_cast<int>(scaleFactor * 1.5), PURPLE);
+	DrawText(("SP: " + to_string(snapshot.regSP)).c_str(), scaleFactor * (VIDEO_WIDTH + 2), scaleFactor * 5, static_cast<int>(scaleFactor * 1.5), BLUE);
 
-	DrawText(("DT: " + to_string(regDT_)).c_str(), scaleFactor * (VIDEO_WIDTH + 10), scaleFactor * 3, static_cast<int>(scaleFactor * 1.5), GREEN);
-	DrawText(("ST: " + to_string(regST_)).c_str(), scaleFactor * (VIDEO_WIDTH + 10), scaleFactor * 5, static_cast<int>(scaleFactor * 1.5), GREEN);
+	DrawText(("DT: " + to_string(snapshot.regDT)).c_str(), scaleFactor * (VIDEO_WIDTH + 10), scaleFactor * 3, static_cast<int>(scaleFactor * 1.5), GREEN);
+	DrawText(("ST: " + to_string(snapshot.regST)).c_str(), scaleFactor * (VIDEO_WIDTH + 10), scaleFactor * 5, static_cast<int>(scaleFactor * 1.5), GREEN);
+
+	if (showHeatmap) return;	// heatmap is drawn in place of Vx registers and stack
 
 	for (int i = 0; i < VREGS_COUNT; ++i) {
 		stringstream ss;
 		ss << std::hex << i;
-		DrawText(("V" + ss.str() + ": " + to_string(regsVx_[i])).c_str(), scaleFactor * (VIDEO_WIDTH + 10), static_cast<int>(scaleFactor * (7 + 1.5 * i)), static_cast<int>(scaleFactor * 1.2), YELLOW);
-		DrawText(("S" + ss.str() + ": " + to_string(stack_[i])).c_str(), scaleFactor * (VIDEO_WIDTH + 2), static_cast<int>(scaleFactor * (7 + 1.5 * i)), static_cast<int>(scaleFactor * 1.2), SKYBLUE);
+		DrawText(("V" + ss.str() + ": " + to_string(snapshot.regsVx[i])).c_str(), scaleFactor * (VIDEO_WIDTH + 10), static_cast<int>(scaleFactor * (7 + 1.5 * i)), static_cast<int>(scaleFactor * 1.2), YELLOW);
+		DrawText(("S" + ss.str() + ": " + to_string(snapshot.stack[i])).c_str(), scaleFactor * (VIDEO_WIDTH + 2), static_cast<int>(scaleFactor * (7 + 1.5 * i)), static_cast<int>(scaleFactor * 1.2), SKYBLUE);
 	}
 
 }
 
-// draw past instructions and their explanations at the bottom
-void ch8Display::drawInstructions() const{
-	for (int i = 0; i < DISPLAY_LAST_COUNT; ++i) {
-		stringstream ss;
-		ss << std::hex << std::uppercase << setfill('0') << setw(4) << lastInstructions_[i];	// show as uppercase hex number padded by zeros to 4 digits
+// draw memory as 64x64 grid - red shows executed instructions, green shows written bytes, current PC is white
+void ch8Display::drawHeatmap(const ch8Snapshot& snapshot) {
+	// brightness is logarithmic and relative to the hottest address -> both hot loops and single writes are visible
+	uint32_t maxHeat = 1;
+	for (uint32_t i = 0; i < HEAT_SIZE; ++i) {
+		maxHeat = max({ maxHeat, snapshot.executeHeat[i], snapshot.writeHeat[i] });
+	}
+	float heatScale = 255.0f / log1p(static_cast<float>(maxHeat));
 
-		// draw just executed instruction white, rest of them gray
-		DrawText((ss.str() + ": " + explanations_[i]).c_str(), scaleFactor * 4, scaleFactor * ((VIDEO_HEIGHT + 1) + 2 * i), static_cast<int>(scaleFactor * 1.5), (i == DISPLAY_LAST_COUNT - 1) ? WHITE : GRAY);
+	for (uint32_t i = 0; i < HEAT_SIZE; ++i) {
+		heatmapPixels[i] = Color{ static_cast<unsigned char>(heatScale * log1p(static_cast<float>(snapshot.executeHeat[i]))),
+			static_cast<unsigned char>(heatScale * log1p(static_cast<float>(snapshot.writeHeat[i]))), 0, 255 };
 	}
-}
+	if (static_cast<uint32_t>(snapshot.regPC >> snapshot.heatShift) < HEAT_SIZE) heatmapPixels[snapshot.regPC >> snapshot.heatShift] = WHITE;
 
+	heatmapTexture.Update(heatmapPixels.data());		// one texture upload for the whole memory
 
-//============ Writing to frame buffer ============//
+	float cellSize = scaleFactor / 4.0f;		// panel is 16 * scaleFactor wide
+	heatmapTexture.Draw(raylib::Rectangle(0, 0, HEATMAP_SIZE, HEATMAP_SIZE),
+		raylib::Rectangle(static_cast<float>(scaleFactor * VIDEO_WIDTH), static_cast<float>(scaleFactor * 7), cellSize * HEATMAP_SIZE, cellSize * HEATMAP_SIZE));
 
-void ch8Display::clear() {
-	frameBuffer.fill(0);
+	DrawText("executed", scaleFactor * (VIDEO_WIDTH + 2), scaleFactor * 24, static_cast<int>(scaleFactor * 1.2), RED);
+	DrawText("written", scaleFactor * (VIDEO_WIDTH + 10), scaleFactor * 24, static_cast<int>(scaleFactor * 1.2), GREEN);
 }
 
-// returns true if any pixel was erased
-bool ch8Display::writeToBuffer(uint8_t spriteByte, uint16_t xCoord, uint16_t yCoord) {
-	xCoord %= VIDEO_WIDTH;		// wrap around if offscreen at the start
-
-	if (yCoord < VIDEO_HEIGHT) {	// clip sprite that is partially offscreen (starting yCoord is already modulo VIDEO_HEIGHT)
-
-		// buffer saves whole bytes but sprite can start in the middle of a byte -> get current value of both possibly affected bytes
-		uint8_t oldFirstBufferVal = frameBuffer[(yCoord * VIDEO_LINE_BYTES) + (xCoord / 8)];
-		uint8_t oldSecondBufferVal = frameBuffer[(yCoord * VIDEO_LINE_BYTES) + (((xCoord / 8) + 1) % VIDEO_LINE_BYTES)];	// % is here because second one could be wrapped
-
-		// yCoord * VIDEO_LINE_BYTES to skip whole line(s)
-		// XOR new values with current values
-		frameBuffer[(yCoord * VIDEO_LINE_BYTES) + (xCoord / 8)] ^= spriteByte >> (xCoord % 8);
-		// condition to clip sprite if only half is offscreen
-		if ((xCoord / 8) + 1 < VIDEO_LINE_BYTES) frameBuffer[(yCoord * VIDEO_LINE_BYTES) + (((xCoord / 8) + 1) % VIDEO_LINE_BYTES)] ^= spriteByte << (8 - (xCoord % 8));
+// core stopped - message and address over the top of the game screen (stays until the window is closed)
+void ch8Display::drawFault(const ch8Snapshot& snapshot) const {
+	stringstream ss;
+	ss << faultMessage(snapshot.fault) << " at " << std::hex << std::uppercase << setfill('0') << setw(4) << snapshot.faultPC;
 
-		// check if any pixel was erased by drawing this -> look at zeros in frameBuffer now and bitmask with previous
-		return ((oldFirstBufferVal & ~frameBuffer[(yCoord * VIDEO_LINE_BYTES) + (xCoord / 8)]) != 0) ||
-			((oldSecondBufferVal & ~frameBuffer[(yCoord * VIDEO_LINE_BYTES) + (((xCoord / 8) + 1) % 8)]) != 0);
-	}
-	
-	return false;	// nothing drawn -> no pixels erased
+	DrawRectangle(0, 0, scaleFactor * VIDEO_WIDTH, scaleFactor * 3, Fade(BLACK, 0.8f));
+	DrawText(ss.str().c_str(), scaleFactor * 1, static_cast<int>(scaleFactor * 0.75), static_cast<int>(scaleFactor * 1.5), RED);
 }
 
+// draw past instructions and their explanations at the bottom
+void ch8Display::drawInstructions(const ch8Snapshot& snapshot) const {
+	for (int i = 0; i < DISPLAY_LAST_COUNT; ++i) {
+		stringstream ss;
+		ss << std::hex << std::uppercase << setfill('0') << setw(4) << snapshot.lastInstructions[i];	// show as uppercase hex number padded by zeros to 4 digits
 
-//============ Buzzer control ============//
-
-void ch8Display::updateBuzzer(){
-	if (buzzerLoaded) {
-		if (!buzzer.IsPlaying()) buzzer.Play();
-		buzzer.Update();	// needs to be called every frame (when the sound is playing)
+		// draw just executed instruction white, rest of them gray
+		DrawText((ss.str() + ": " + snapshot.explanations[i]).c_str(), scaleFactor * 4, scaleFactor * ((VIDEO_HEIGHT + 1) + 2 * i), static_cast<int>(scaleFactor * 1.5), (i == DISPLAY_LAST_COUNT - 1) ? WHITE : GRAY);
 	}
 }
-
-void ch8Display::stopBuzzer(){
-	if (buzzerLoaded) {
-		buzzer.Pause();
-		buzzer.Seek(0);		// always play from the start
-	}
-}
\ No newline at end of file
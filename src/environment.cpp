@@ -0,0 +1,125 @@
+#include "environment.hpp"
+
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+ch8Environment::ch8Environment(const ch8Options& options, const string& romPath, int count, int frameSkip, uint32_t seed)
+	: options(options), frameSkip(frameSkip), seed(seed)
+{
+	if (count <= 0) throw runtime_error("Environment needs at least one copy of the game!");
+	if (frameSkip <= 0) throw runtime_error("Frame skip has to be at least 1!");
+
+	// nothing is shown, so nothing is explained, profiled or traced
+	this->options.enableExplanations = false;
+	this->options.enableProfiling = false;
+	this->options.tracePath.clear();
+
+	// the ROM is read once, resets only load the state after it
+	chip8 loader(this->options);
+	loader.loadROM(romPath);
+	loader.saveFork(initialState);
+
+	for (int i = 0; i < count; ++i) cores.push_back(make_unique<chip8>(this->options));
+	frames.assign(count, 0);
+	episodes.assign(count, 0);
+	lastActions.assign(count, 0);
+	rewards.assign(count, 0.0f);
+	dones.assign(count, 0);
+	errors.resize(count);
+
+	unsigned threads = (options.threads > 0) ? options.threads : max(1u, thread::hardware_concurrency());
+	threads = min(threads, static_cast<unsigned>(count));
+	if (threads > 1) pool = make_unique<ch8WorkPool>(threads);
+
+	// a few chunks per thread, so threads that finish early can take some from the others
+	int chunks = static_cast<int>(threads) * 4;
+	chunkSize = (count + chunks - 1) / chunks;
+
+	reset();
+}
+
+void ch8Environment::reset() {
+	for (int i = 0; i < size(); ++i) resetOne(i);
+}
+
+void ch8Environment::reset(int index) {
+	resetOne(index);
+}
+
+void ch8Environment::resetOne(int index) {
+	cores[index]->loadFork(initialState);
+	cores[index]->seedRandom(seed + index + episodes[index] * static_cast<uint32_t>(size()));		// every episode of every copy is different, but repeatable
+	++episodes[index];
+
+	frames[index] = 0;
+	lastActions[index] = 0;
+	rewards[index] = 0.0f;
+	dones[index] = 0;
+	errors[index].clear();
+}
+
+void ch8Environment::step(const uint16_t* actions) {
+	if (!pool) {
+		for (int i = 0; i < size(); ++i) stepOne(i, actions[i]);
+		return;
+	}
+
+	for (int first = 0; first < size(); first += chunkSize) {
+		int last = min(first + chunkSize, size());
+		pool->submit([this, actions, first, last] {
+			for (int i = first; i < last; ++i) stepOne(i, actions[i]);
+		});
+	}
+	pool->wait();
+}
+
+// frameSkip frames with the same keys held, rewards of all of them are added up
+void ch8Environment::stepOne(int index, uint16_t action) {
+	if (dones[index]) resetOne(index);
+
+	chip8& core = *cores[index];
+	float reward = 0.0f;
+	core.setKeypad(action, action & ~lastActions[index]);
+	for (int i = 0; i < frameSkip; ++i) {
+		if (core.emulateOneFrame(ch8Scheduler::instructionsInTick(options.speed, frames[index])) != ch8Fault::NONE) {
+			dones[index] = 1;
+			errors[index] = core.describeFault();
+			break;
+		}
+		core.setKeypad(action, 0);		// a press only counts in the first frame
+		++frames[index];
+
+		if (rewardHook) reward += rewardHook(core, index);
+		if (doneHook && doneHook(core, index)) {
+			dones[index] = 1;
+			break;
+		}
+		if (options.stopOnHalt && core.isHalted()) {		// nothing the agent does matters any more
+			dones[index] = 1;
+			break;
+		}
+	}
+
+	lastActions[index] = action;
+	rewards[index] = reward;
+}
+
+void ch8Environment::saveState(int index, ch8EnvState& state) const {
+	cores[index]->saveFork(state.core);
+	state.frame = frames[index];
+}
+
+// restoring a state continues its episode - done flag, reward and error of the last step are cleared
+void ch8Environment::loadState(int index, const ch8EnvState& state) {
+	cores[index]->loadFork(state.core);
+	frames[index] = state.frame;
+	lastActions[index] = state.core.keypadHeld;
+	rewards[index] = 0.0f;
+	dones[index] = 0;
+	errors[index].clear();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "chip8.hpp"
+#include "options.hpp"
+#include "workpool.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// state of one environment - a save state of the core and the frame number (instructions per frame depend on it)
+struct ch8EnvState {
+	ch8ForkState core;
+	uint64_t frame;
+};
+
+// called after every emulated frame of an environment (from worker threads, so they must not share unsynchronized data)
+using ch8RewardHook = std::function<float(const chip8& core, int index)>;
+using ch8DoneHook = std::function<bool(const chip8& core, int index)>;
+
+// many copies of one game for training agents (see ch8env.h for the C interface)
+// step() takes an action (held keypad keys) for every environment and emulates frameSkip frames with it,
+// environments are split between threads of a work pool and rewards, done flags and screens are read in place afterwards
+class ch8Environment {
+private:
+	ch8Options options;
+	int frameSkip;
+	uint32_t seed;
+
+	std::vector<std::unique_ptr<chip8>> cores;
+	std::vector<uint64_t> frames;			// frames since the last reset
+	std::vector<uint32_t> episodes;			// every reset uses a different random seed
+	std::vector<uint16_t> lastActions;		// newly held keys count as pressed (FX0A)
+	ch8ForkState initialState;				// right after loading the ROM
+
+	// results of the last step
+	std::vector<float> rewards;
+	std::vector<uint8_t> dones;
+	std::vector<std::string> errors;		// why an environment ended by an error (empty otherwise)
+
+	ch8RewardHook rewardHook;
+	ch8DoneHook doneHook;
+
+	std::unique_ptr<ch8WorkPool> pool;		// only exists with more than one thread
+	int chunkSize;
+
+	void resetOne(int index);
+	void stepOne(int index, uint16_t action);
+
+public:
+	// options.threads threads (0 = one per hardware thread), options.speed instructions per second
+	ch8Environment(const ch8Options& options, const std::string& romPath, int count, int frameSkip, uint32_t seed);
+
+	void setRewardHook(ch8RewardHook hook) { rewardHook = std::move(hook); }
+	void setDoneHook(ch8DoneHook hook) { doneHook = std::move(hook); }
+
+	void reset();					// all environments
+	void reset(int index);
+	void step(const uint16_t* actions);		// one action per environment, environments that were done are reset first
+
+	int size() const { return static_cast<int>(cores.size()); }
+
+	// valid until the next step or reset - pointers stay the same for the whole life of the environment
+	const float* getRewards() const { return rewards.data(); }
+	const uint8_t* getDones() const { return dones.data(); }
+	const std::string& getError(int index) const { return errors[index]; }
+	const chip8& getCore(int index) const { return *cores[index]; }
+	const ch8FrameBuffer& getFrameBuffer(int index) const { return cores[index]->getFrameBuffer(); }
+
+	void saveState(int index, ch8EnvState& state) const;
+	void loadState(int index, const ch8EnvState& state);
+};
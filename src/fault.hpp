@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// why a core stopped - latched by the core together with the PC of the instruction, the instruction itself isn't finished
+// (memory and registers stay as they were before it, PC stays on it), emulation continues only after a reset or loaded state
+enum class ch8Fault : uint8_t {
+	NONE,
+	UNKNOWN_INSTRUCTION,
+	STACK_OVERFLOW,
+	STACK_UNDERFLOW,
+	FONT_OUT_OF_RANGE,		// FX29 and FX30 with a value above F
+	INVALID_KEY,			// EX9E and EXA1 with a value above F
+	MEMORY_READ,
+	MEMORY_WRITE,
+	INSTRUCTION_READ,		// PC at the last byte of memory
+};
+
+inline const char* faultMessage(ch8Fault fault) {
+	switch (fault) {
+	case ch8Fault::NONE: return "No fault";
+	case ch8Fault::UNKNOWN_INSTRUCTION: return "Unknown instruction!";
+	case ch8Fault::STACK_OVERFLOW: return "Stack overflow!";
+	case ch8Fault::STACK_UNDERFLOW: return "Stack underflow!";
+	case ch8Fault::FONT_OUT_OF_RANGE: return "Trying to access font symbol out of range!";
+	case ch8Fault::INVALID_KEY: return "Checked status of an invalid key!";
+	case ch8Fault::MEMORY_READ: return "Trying to read outside of memory space!";
+	case ch8Fault::MEMORY_WRITE: return "Trying to write outside of memory space!";
+	case ch8Fault::INSTRUCTION_READ: return "Trying to read instruction outside of memory space!";
+	}
+	return "Unknown fault!";
+}
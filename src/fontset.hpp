@@ -4,6 +4,7 @@
 
 constexpr int CHARACTER_BYTES = 5;
 constexpr int FONTSET_CHAR_COUNT = 16;
+constexpr int BIG_CHARACTER_BYTES = 10;		// SUPER-CHIP 8x10 digits
 
 // predefined hex digit images/bitmaps
 // program can load them using instruction LOAD_DIGIT (0xF029)
@@ -24,4 +25,25 @@ constexpr std::array<uint8_t, FONTSET_CHAR_COUNT * CHARACTER_BYTES> fontset = {
 	0xE0, 0x90, 0x90, 0x90, 0xE0,		// D
 	0xF0, 0x80, 0xF0, 0x80, 0xF0,		// E
 	0xF0, 0x80, 0xF0, 0x80, 0x80		// F
+};
+
+// bigger digits for high resolution (SUPER-CHIP)
+// program can load them using instruction LOAD_BIG_DIGIT (0xF030)
+constexpr std::array<uint8_t, FONTSET_CHAR_COUNT * BIG_CHARACTER_BYTES> bigFontset = {
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,		// 0
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,		// 1
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,		// 2
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,		// 3
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,		// 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,		// 5
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,		// 6
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,		// 7
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,		// 8
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,		// 9
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,		// A
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,		// B
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,		// C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,		// D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,		// E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0		// F
 };
\ No newline at end of file
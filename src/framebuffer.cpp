@@ -0,0 +1,132 @@
+#include "framebuffer.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+static_assert(sizeof(array<array<uint64_t, PLANE_WORDS>, MAX_PLANES>) == MAX_PLANES * PLANE_WORDS * sizeof(uint64_t), "data() gives all planes as one block");
+
+ch8FrameBuffer::ch8FrameBuffer() {
+	clear();		// initialize as blank screen
+}
+
+void ch8FrameBuffer::clear(uint8_t planeMask) {
+	for (int p = 0; p < MAX_PLANES; ++p) {
+		if (planeMask & (1 << p)) planes[p].fill(0);
+	}
+	recomputeHash();
+}
+
+// zero words have no key, so an empty plane is cheap
+void ch8FrameBuffer::recomputeHash() {
+	contentHash = 0;
+	for (int p = 0; p < MAX_PLANES; ++p) {
+		for (int word = 0; word < PLANE_WORDS; ++word) contentHash ^= zobristKey(p * PLANE_WORDS + word, planes[p][word]);
+	}
+}
+
+void ch8FrameBuffer::setHiRes(bool enable) {
+	hiRes = enable;
+	clear();
+}
+
+// returns true if any pixel was erased
+bool ch8FrameBuffer::drawSpriteRow(int planeIndex, uint16_t spriteRow, uint16_t xCoord, uint16_t yCoord) {
+	xCoord %= width();		// wrap around if offscreen at the start
+	if (yCoord >= height()) return false;	// clip sprite that is partially offscreen (starting yCoord is already wrapped)
+
+	// sprite line moved to its position - can be split between two words
+	int word = xCoord / 64;
+	int offset = xCoord % 64;
+	uint64_t sprite = static_cast<uint64_t>(spriteRow) << 48;
+	uint64_t firstPart = sprite >> offset;
+	uint64_t secondPart = (offset != 0) ? (sprite << (64 - offset)) : 0;
+
+	int index = planeIndex * PLANE_WORDS + yCoord * ROW_WORDS + word;		// of the first word in all planes (hash key)
+	uint64_t* row = &planes[planeIndex][yCoord * ROW_WORDS];
+	bool erased = (row[word] & firstPart) != 0;
+	contentHash ^= zobristKey(index, row[word]) ^ zobristKey(index, row[word] ^ firstPart);
+	row[word] ^= firstPart;
+
+	// second part is clipped at the right edge of the screen
+	if (word + 1 < activeWords()) {
+		erased = erased || (row[word + 1] & secondPart) != 0;
+		contentHash ^= zobristKey(index + 1, row[word + 1]) ^ zobristKey(index + 1, row[word + 1] ^ secondPart);
+		row[word + 1] ^= secondPart;
+	}
+
+	return erased;
+}
+
+// moves whole lines down, new lines at the top are empty
+void ch8FrameBuffer::scrollDown(uint8_t planeMask, int lines) {
+	lines = min(lines, height());
+	for (int p = 0; p < MAX_PLANES; ++p) {
+		if (!(planeMask & (1 << p))) continue;
+
+		plane& rows = planes[p];
+		copy_backward(rows.begin(), rows.begin() + (height() - lines) * ROW_WORDS, rows.begin() + height() * ROW_WORDS);
+		fill(rows.begin(), rows.begin() + lines * ROW_WORDS, 0);
+	}
+	recomputeHash();
+}
+
+// moves whole lines up, new lines at the bottom are empty
+void ch8FrameBuffer::scrollUp(uint8_t planeMask, int lines) {
+	lines = min(lines, height());
+	for (int p = 0; p < MAX_PLANES; ++p) {
+		if (!(planeMask & (1 << p))) continue;
+
+		plane& rows = planes[p];
+		copy(rows.begin() + lines * ROW_WORDS, rows.begin() + height() * ROW_WORDS, rows.begin());
+		fill(rows.begin() + (height() - lines) * ROW_WORDS, rows.begin() + height() * ROW_WORDS, 0);
+	}
+	recomputeHash();
+}
+
+// pixels shifted out of a word continue in the next one (pixels is less than 64)
+void ch8FrameBuffer::scrollRight(uint8_t planeMask, int pixels) {
+	for (int p = 0; p < MAX_PLANES; ++p) {
+		if (!(planeMask & (1 << p))) continue;
+
+		for (int y = 0; y < height(); ++y) {
+			uint64_t* row = &planes[p][y * ROW_WORDS];
+			for (int word = activeWords() - 1; word > 0; --word) {
+				row[word] = (row[word] >> pixels) | (row[word - 1] << (64 - pixels));
+			}
+			row[0] >>= pixels;
+		}
+	}
+	recomputeHash();
+}
+
+void ch8FrameBuffer::scrollLeft(uint8_t planeMask, int pixels) {
+	for (int p = 0; p < MAX_PLANES; ++p) {
+		if (!(planeMask & (1 << p))) continue;
+
+		for (int y = 0; y < height(); ++y) {
+			uint64_t* row = &planes[p][y * ROW_WORDS];
+			for (int word = 0; word < activeWords() - 1; ++word) {
+				row[word] = (row[word] << pixels) | (row[word + 1] >> (64 - pixels));
+			}
+			row[activeWords() - 1] <<= pixels;
+		}
+	}
+	recomputeHash();
+}
+
+uint64_t ch8FrameBuffer::hash() const {
+	uint64_t value = FNV_OFFSET_BASIS;
+	auto add = [&value](uint64_t word) {
+		for (int byte = 0; byte < 8; ++byte) {
+			value ^= (word >> (8 * byte)) & 0xFF;
+			value *= FNV_PRIME;
+		}
+	};
+
+	for (const plane& p : planes) {
+		for (uint64_t word : p) add(word);
+	}
+	add(hiRes);
+	return value;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "statehash.hpp"
+
+#include <array>
+#include <cstdint>
+
+// video = game/program screen
+constexpr int VIDEO_WIDTH = 64;			// low resolution (CHIP-8)
+constexpr int VIDEO_HEIGHT = 32;
+constexpr int HIRES_WIDTH = 128;		// high resolution (SUPER-CHIP)
+constexpr int HIRES_HEIGHT = 64;
+constexpr int ROW_WORDS = HIRES_WIDTH / 64;		// 64-bit words to store one line
+constexpr int PLANE_WORDS = ROW_WORDS * HIRES_HEIGHT;
+constexpr int MAX_PLANES = 4;			// XO-CHIP bitplanes -> up to 16 colors
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325;		// 64-bit FNV-1a hash
+constexpr uint64_t FNV_PRIME = 0x100000001b3;
+
+constexpr uint8_t ALL_PLANES = (1 << MAX_PLANES) - 1;
+
+// stores all pixels of one frame, each pixel is one bit, one line is stored in ROW_WORDS words
+// (leftmost pixel of a word is the highest bit) -> drawing and scrolling are a few word operations per line
+// low resolution only uses the first word of the first VIDEO_HEIGHT lines
+// every bitplane is stored separately in the same format, plane 0 is the only one used by CHIP-8 and SUPER-CHIP
+class ch8FrameBuffer {
+private:
+	using plane = std::array<uint64_t, PLANE_WORDS>;
+	std::array<plane, MAX_PLANES> planes;
+	bool hiRes = false;
+	uint64_t contentHash = 0;		// XOR of zobristKey(word index, word) of all planes - kept up to date by drawing
+
+	int activeWords() const { return hiRes ? ROW_WORDS : 1; }
+	void recomputeHash();		// after clearing and scrolling, which change whole planes anyway
+
+public:
+	ch8FrameBuffer();
+
+	void clear(uint8_t planeMask = ALL_PLANES);
+	void setHiRes(bool enable);		// switching resolution clears the screen
+	bool isHiRes() const { return hiRes; }
+	int width() const { return hiRes ? HIRES_WIDTH : VIDEO_WIDTH; }
+	int height() const { return hiRes ? HIRES_HEIGHT : VIDEO_HEIGHT; }
+
+	// XORs one line of a sprite (up to 16 pixels, leftmost is the highest bit) - returns true if any pixel was erased
+	bool drawSpriteRow(int planeIndex, uint16_t spriteRow, uint16_t xCoord, uint16_t yCoord);
+
+	// SUPER-CHIP and XO-CHIP scrolling (by pixels of the current resolution)
+	void scrollDown(uint8_t planeMask, int lines);
+	void scrollUp(uint8_t planeMask, int lines);
+	void scrollRight(uint8_t planeMask, int pixels);
+	void scrollLeft(uint8_t planeMask, int pixels);
+
+	bool isPixelSet(int x, int y, int planeIndex = 0) const {
+		return ((planes[planeIndex][(y * ROW_WORDS) + (x / 64)] >> (63 - (x % 64))) & 1) != 0;
+	}
+	uint64_t getWord(int planeIndex, int y, int word) const { return planes[planeIndex][(y * ROW_WORDS) + word]; }
+	const uint64_t* data() const { return planes[0].data(); }		// all planes one after another (PLANE_WORDS each) - lets others read the screen without copying
+	bool operator==(const ch8FrameBuffer& other) const = default;
+
+	// FNV-1a of all planes and the resolution - compares screens of runs without storing them
+	uint64_t hash() const;
+	uint64_t getContentHash() const { return contentHash; }		// O(1) hash of the planes (not the resolution) for chip8::hashState
+};
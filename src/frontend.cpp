@@ -0,0 +1,198 @@
+#include "frontend.hpp"
+#include "keymap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+ch8Frontend::ch8Frontend(const ch8Options& options)
+	: core(options)
+	, display(options.scale, options.renderFPS, options.enableExplanations, options.mainColor, options.BGColor)
+	, scheduler(options.speed)
+	, runAhead(options.runAhead)
+	, enableProfiling(options.enableProfiling)
+	, keyLayout(options.keymap)
+	, measureLatency(options.measureLatency)
+{
+	if (options.autoSpeed) speedTuner = make_unique<ch8SpeedTuner>(options.speed);
+
+	core.setSoundListener([this](uint8_t soundTimer) { audio.setSoundTimer(soundTimer); });
+	core.setToneListener([this](const array<uint8_t, AUDIO_PATTERN_BYTES>& pattern, uint8_t pitch) { audio.setTone(pattern, pitch); });
+
+	if (runAhead > 0) {
+		// speculative frames mustn't show up in statistics, trace or explanations
+		ch8Options aheadOptions = options;
+		aheadOptions.enableProfiling = false;
+		aheadOptions.tracePath.clear();
+		aheadOptions.enableExplanations = false;
+		aheadCore = make_unique<chip8>(aheadOptions);
+	}
+}
+
+void ch8Frontend::loadROM(const string& fileName) {
+	core.loadROM(fileName);
+}
+
+// main loop - renders newest frame and reads input until user closes the window
+void ch8Frontend::run() {
+	emulationThread = thread(&ch8Frontend::emulationLoop, this);
+
+	while (running.load() && !display.shouldClose()) {
+		frames.update();		// keeps the previous frame if emulation didn't finish a new one yet
+		const ch8Snapshot& snapshot = frames.readBuffer();
+		display.update(snapshot);		// returns after the frame is presented (and input polled)
+		if (measureLatency) measurePresent(snapshot);
+
+		handleInput();
+	}
+
+	running.store(false);
+	emulationThread.join();
+
+	if (emulationError) rethrow_exception(emulationError);
+	if (measureLatency) printLatency();
+	if (speedTuner) cout << "Automatic speed ended at " << speedTuner->getSpeed() << " instr/sec (add it to the ROM database to start with it)" << endl;
+	if (enableProfiling) {
+		core.printProfile();
+		if (scheduler.getDroppedTicks() != 0) cout << "Dropped frames (emulation fell behind): " << scheduler.getDroppedTicks() << endl;
+	}
+}
+
+
+//============ Emulation thread ============//
+
+void ch8Frontend::emulationLoop() {
+	try {
+		while (running.load()) {
+			if (profileRequested.exchange(false)) core.printProfile();		// show statistics collected so far
+
+			if (paused.load()) {
+				if (stepRequests.load() > 0) {
+					--stepRequests;
+					emulateFrame(1);				// advance one instruction
+					publishFrame();
+				}
+				else {
+					this_thread::sleep_for(chrono::milliseconds(1));
+				}
+				scheduler.restart();		// don't try to catch up on the time spent paused
+				continue;
+			}
+
+			// timers always tick at 60 Hz, instructions are spread over the ticks (speeds below 60 get some empty ticks)
+			int ticks = scheduler.ticksDue();
+			for (int i = 0; i < ticks && !paused.load(); ++i) {
+				int IPC = scheduler.instructionsForTick();
+				emulateFrame(IPC);
+				if (speedTuner) scheduler.setSpeed(speedTuner->update(IPC, core.getIdleInstructions()));
+			}
+			if (ticks > 0) publishFrame();		// only the newest frame is worth showing after catching up
+
+			scheduler.sleepUntilNextTick();
+		}
+	}
+	catch (...) {
+		emulationError = current_exception();		// handled by run() after the thread ends
+		running.store(false);
+	}
+}
+
+void ch8Frontend::emulateFrame(int IPC) {
+	seenInput = inputSequence.load();		// read before the presses -> press with this number is surely included
+	core.setKeypad(keypadHeld.load(), keypadPressed.exchange(0));
+
+	ch8Fault fault = core.emulateOneFrame(IPC);
+	if (fault != ch8Fault::NONE && !faultReported) {
+		// window stays open and paused on the faulting instruction, registers and memory can still be inspected
+		cout << "Emulation stopped: " << core.describeFault() << endl;
+		faultReported = true;
+		paused.store(true);
+	}
+}
+
+void ch8Frontend::publishFrame() {
+	ch8Snapshot& snapshot = frames.writeBuffer();
+	core.fillSnapshot(snapshot);
+	snapshot.inputSequence = seenInput;
+	if (runAhead > 0 && !paused.load()) emulateAhead(snapshot);		// stepping shows the real state
+	frames.publish();
+}
+
+// games often react to a key only a frame or two after reading it -> show the frame where the reaction is already drawn
+// registers and timers (so the buzzer too) stay from the real state, only the screen comes from the future
+void ch8Frontend::emulateAhead(ch8Snapshot& snapshot) {
+	core.saveFork(aheadState);
+	aheadCore->loadFork(aheadState);
+	aheadCore->setKeypad(aheadState.keypadHeld, 0);		// keys stay held, but presses were already handled by the real core
+
+	for (int i = 1; i <= runAhead; ++i) {
+		// keep the real frame, the real core reports the fault once it gets there
+		if (aheadCore->emulateOneFrame(scheduler.instructionsAhead(i - 1)) != ch8Fault::NONE) return;
+	}
+
+	snapshot.frameBuffer = aheadCore->getFrameBuffer();
+}
+
+
+//============ Render thread ============//
+
+// reads keypad (uses keymap to get keyboard keys corresponding to chip-8 keypad) and emulator controls
+void ch8Frontend::handleInput() {
+	const array<KeyboardKey, KEYPAD_KEYS>& keys = keymapFor(keyLayout);
+	uint16_t held = 0;
+	uint16_t pressed = 0;
+	for (int i = 0; i < KEYPAD_KEYS; ++i) {
+		if (IsKeyDown(keys[i])) held |= 1 << i;
+		if (IsKeyPressed(keys[i])) pressed |= 1 << i;
+	}
+	keypadHeld.store(held);
+	keypadPressed.fetch_or(pressed);		// kept until the emulation thread takes them -> short presses aren't lost
+
+	if (pressed != 0) {
+		uint32_t sequence = inputSequence.fetch_add(1) + 1;
+		if (measureLatency && pendingInput == 0) {		// measure one press at a time
+			pendingInput = sequence;
+			pendingSince = chrono::steady_clock::now();
+		}
+	}
+
+	// Space pauses, Enter advances one instruction while paused, P prints profile, H switches to heatmap
+	for (int key = GetKeyPressed(); key != 0; key = GetKeyPressed()) {
+		if (key == KEY_SPACE) {
+			paused.store(!paused.load());
+			audio.setMuted(paused.load());
+		}
+		else if (key == KEY_ENTER && paused.load()) ++stepRequests;
+		else if (key == KEY_P && enableProfiling) profileRequested.store(true);
+		else if (key == KEY_H) display.toggleHeatmap();
+	}
+}
+
+
+//============ Latency measurement ============//
+
+// press counts as shown once a presented frame was emulated after the emulation thread took it
+void ch8Frontend::measurePresent(const ch8Snapshot& snapshot) {
+	if (pendingInput == 0 || snapshot.inputSequence < pendingInput) return;
+
+	chrono::steady_clock::duration latency = chrono::steady_clock::now() - pendingSince;
+	++latencyCount;
+	latencyTotal += latency;
+	latencyMin = min(latencyMin, latency);
+	latencyMax = max(latencyMax, latency);
+	pendingInput = 0;
+}
+
+void ch8Frontend::printLatency() const {
+	if (latencyCount == 0) {
+		cout << "Input latency: no keypad presses measured" << endl;
+		return;
+	}
+
+	auto toMs = [](chrono::steady_clock::duration d) { return chrono::duration<double, milli>(d).count(); };
+	cout << "Input latency (keypress to present) over " << latencyCount << " presses: average " << toMs(latencyTotal / latencyCount)
+		<< " ms, min " << toMs(latencyMin) << " ms, max " << toMs(latencyMax) << " ms" << endl;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "audio.hpp"
+#include "chip8.hpp"
+#include "display.hpp"
+#include "options.hpp"
+#include "scheduler.hpp"
+#include "triplebuffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+
+// runs the emulator core on its own thread and shows its frames in a window on the main thread
+// emulation thread publishes finished frames through a triple buffer, input goes the other way through atomic masks
+class ch8Frontend {
+private:
+	chip8 core;				// only used by the emulation thread while it's running
+	ch8Display display;		// only used by the main (render) thread
+	ch8Audio audio;			// buzzer runs on its own (audio) thread
+	ch8TripleBuffer<ch8Snapshot> frames;
+
+	ch8Scheduler scheduler;		// emulation thread pacing
+	std::unique_ptr<ch8SpeedTuner> speedTuner;		// only exists with automatic speed
+
+	// run-ahead - a second core continues from the state of the real one, its frame is shown instead
+	int runAhead;
+	std::unique_ptr<chip8> aheadCore;		// only exists with run-ahead enabled
+	ch8ForkState aheadState;
+	bool enableProfiling;
+	ch8Keymap keyLayout;		// keyboard keys of the keypad (render thread)
+
+	// render thread -> emulation thread
+	std::atomic<uint16_t> keypadHeld{ 0 };			// bit n is keypad key n
+	std::atomic<uint16_t> keypadPressed{ 0 };		// keys pressed since the emulation thread last took them
+	std::atomic<bool> running{ true };
+	std::atomic<bool> paused{ false };
+	std::atomic<int> stepRequests{ 0 };				// instructions to advance while paused
+	std::atomic<bool> profileRequested{ false };
+	std::atomic<uint32_t> inputSequence{ 0 };		// counts keypad presses, lets the render thread recognize frames showing them
+
+	uint32_t seenInput = 0;		// emulation thread - newest press handed to the core
+	bool faultReported = false;	// emulation thread - core stopped and the emulator got paused
+
+	// keypress to present latency (render thread)
+	bool measureLatency;
+	uint32_t pendingInput = 0;		// press waiting to be shown (0 = none)
+	std::chrono::steady_clock::time_point pendingSince;
+	int latencyCount = 0;
+	std::chrono::steady_clock::duration latencyTotal{};
+	std::chrono::steady_clock::duration latencyMin = std::chrono::steady_clock::duration::max();
+	std::chrono::steady_clock::duration latencyMax{};
+
+	std::thread emulationThread;
+	std::exception_ptr emulationError;		// exception thrown on the emulation thread, rethrown by run()
+
+	// emulation thread
+	void emulationLoop();
+	void emulateFrame(int IPC);		// runs one frame (tick)
+	void publishFrame();
+	void emulateAhead(ch8Snapshot& snapshot);	// replaces the screen in snapshot with one runAhead frames in the future
+
+	// render thread
+	void handleInput();
+	void measurePresent(const ch8Snapshot& snapshot);
+	void printLatency() const;
+
+public:
+	ch8Frontend(const ch8Options& options);
+	void loadROM(const std::string& fileName);
+	void run();		// begins executing instructions, returns when the window is closed
+};
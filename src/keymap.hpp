@@ -2,13 +2,25 @@
 
 #include "raylib.h"
 
-#include <array>
+#include "options.hpp"
+#include "state.hpp"
 
-constexpr int KEYPAD_KEYS = 16;
+#include <array>
 
 // used when mapping Chip-8 keypad controls to keyboards
 constexpr std::array<KeyboardKey, KEYPAD_KEYS> keymap{
 	KEY_X, KEY_ONE, KEY_TWO, KEY_THREE,				// 0 - 3
 	KEY_Q, KEY_W, KEY_E, KEY_A, KEY_S, KEY_D,		// 4 - 9
 	KEY_Z, KEY_C, KEY_FOUR, KEY_R, KEY_F, KEY_V		// A - F
-};
\ No newline at end of file
+};
+
+// games moving with 5, 7, 8 and 9 (W, A, S, D above - usual in Octo games) - arrow keys replace them
+constexpr std::array<KeyboardKey, KEYPAD_KEYS> arrowKeymap{
+	KEY_X, KEY_ONE, KEY_TWO, KEY_THREE,						// 0 - 3
+	KEY_Q, KEY_UP, KEY_E, KEY_LEFT, KEY_DOWN, KEY_RIGHT,	// 4 - 9
+	KEY_Z, KEY_C, KEY_FOUR, KEY_R, KEY_F, KEY_V			// A - F
+};
+
+inline const std::array<KeyboardKey, KEYPAD_KEYS>& keymapFor(ch8Keymap layout) {
+	return (layout == ch8Keymap::ARROWS) ? arrowKeymap : keymap;
+}
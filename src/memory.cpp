@@ -1,30 +1,102 @@
 
 #include "memory.hpp"
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
 
 using namespace std;
 
 ch8Memory::ch8Memory() {
-	memory.fill(0);		// initialize to zeros
+	clear();		// initialize to zeros
+}
+
+// own pages are reused (pooled cores), the others are replaced - forks keep them
+void ch8Memory::clear() {
+	pages.resize(size / PAGE_SIZE);
+	for (uint32_t page = 0; page < pages.size(); ++page) {
+		if (ownPages[page] && pages[page]) pages[page]->fill(0);
+		else pages[page] = make_shared<memoryPage>();		// zeroed
+		pageData[page] = pages[page]->data();
+	}
+	ownPages.reset();
+	for (uint32_t page = 0; page < pages.size(); ++page) ownPages[page] = true;
+	writeHeat.fill(0);
+	contentHash = 0;
+}
+
+// ownership is tracked here instead of asking shared_ptr::use_count, which isn't reliable while other threads drop their forks
+memoryPage& ch8Memory::writablePage(uint32_t page) {
+	if (!ownPages[page]) {
+		pages[page] = make_shared<memoryPage>(*pages[page]);
+		pageData[page] = pages[page]->data();
+		ownPages[page] = true;
+	}
+	return *pages[page];
+}
+
+pageTable const& ch8Memory::forkPages() const {
+	ownPages.reset();
+	return pages;
+}
+
+void ch8Memory::sharePages(const pageTable& shared, uint64_t sharedHash) {
+	pages = shared;
+	for (uint32_t page = 0; page < pages.size(); ++page) pageData[page] = pages[page]->data();
+	ownPages.reset();
+	contentHash = sharedHash;
+}
+
+void ch8Memory::setSize(uint32_t newSize) {
+	if (newSize < CHIP8_MEMORY_SIZE || newSize > MEMORY_SIZE || (newSize & (newSize - 1)) != 0) throw runtime_error("Invalid memory size!");
+
+	size = newSize;
+	heatShift = 0;
+	while ((HEAT_SIZE << heatShift) < size) ++heatShift;
+	clear();
 }
 
 // write one byte to memory
-void ch8Memory::writeAtPos(uint16_t pos, uint8_t val) {
-	if (pos > MEMORY_SIZE - 1 || pos < 0) throw runtime_error("Trying to write outside of memory space!");
+bool ch8Memory::writeAtPos(uint16_t pos, uint8_t val) {
+	if (pos >= size) return false;
+
+	uint8_t& byte = writablePage(pos / PAGE_SIZE)[pos % PAGE_SIZE];
+	contentHash ^= zobristKey(pos, byte) ^ zobristKey(pos, val);
+	byte = val;
+	++writeHeat[pos >> heatShift];
+	return true;
+}
 
-	memory[pos] = val;
+// with the whole 64kB address space usable any range wraps around, smaller memory has to contain all of it
+bool ch8Memory::rangeFits(uint16_t pos, size_t length) const {
+	if (length > size) return false;
+	return size == MEMORY_SIZE || pos + length <= size;
 }
 
-// read one byte from memory
-uint8_t ch8Memory::readAtPos(uint16_t pos) const {
-	if (pos > MEMORY_SIZE - 1 || pos < 0) throw runtime_error("Trying to read outside of memory space!");
-	return memory[pos];
+// both go page by page, a uint16_t position wraps around by itself
+bool ch8Memory::write(uint16_t pos, span<const uint8_t> data) {
+	if (!rangeFits(pos, data.size())) return false;
+
+	for (size_t done = 0; done < data.size();) {
+		uint16_t at = static_cast<uint16_t>(pos + done);
+		size_t chunk = min<size_t>(data.size() - done, PAGE_SIZE - at % PAGE_SIZE);
+		uint8_t* bytes = &writablePage(at / PAGE_SIZE)[at % PAGE_SIZE];
+		for (size_t i = 0; i < chunk; ++i) contentHash ^= zobristKey(at + i, bytes[i]) ^ zobristKey(at + i, data[done + i]);
+		memcpy(bytes, data.data() + done, chunk);
+		done += chunk;
+	}
+
+	for (size_t i = 0; i < data.size(); ++i) ++writeHeat[static_cast<uint16_t>(pos + i) >> heatShift];
+	return true;
 }
 
-// read two bytes from memory (one instruction)
-uint16_t ch8Memory::readInstuctionAtPos(uint16_t pos) const {
-	if (pos > MEMORY_SIZE - 2 || pos < 0) throw runtime_error("Trying to read instruction outside of memory space!");
+bool ch8Memory::read(uint16_t pos, span<uint8_t> out) const {
+	if (!rangeFits(pos, out.size())) return false;
 
-	uint16_t instruction = (memory[pos] << 8) | memory[pos + 1];
-	return instruction;
-}
\ No newline at end of file
+	for (size_t done = 0; done < out.size();) {
+		uint16_t at = static_cast<uint16_t>(pos + done);
+		size_t chunk = min<size_t>(out.size() - done, PAGE_SIZE - at % PAGE_SIZE);
+		memcpy(out.data() + done, &byteAt(at), chunk);
+		done += chunk;
+	}
+	return true;
+}
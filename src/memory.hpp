@@ -1,16 +1,94 @@
 #pragma once
 
+#include "statehash.hpp"
+
 #include <array>
+#include <bitset>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+constexpr uint32_t MEMORY_SIZE = 0x10000;			// largest address space (XO-CHIP has 64kB)
+constexpr uint32_t CHIP8_MEMORY_SIZE = 4096;		// Chip-8 RAM is 4kB (address 0x000 (0) to 0xFFF (4095))
+constexpr uint32_t HEAT_SIZE = 4096;				// heatmap cells - one per byte of 4kB memory, bigger memory shares cells
+constexpr int HEAT_DECAY_SHIFT = 3;			// heatmap counters lose 1/8 of their value every frame
+constexpr uint32_t PAGE_SIZE = 256;				// memory is shared between forked cores by pages of this size
+
+
+// pages of one memory - a page can be shared by many memories (forks), it's copied before the first write to it
+using memoryPage = std::array<uint8_t, PAGE_SIZE>;
+using pageTable = std::vector<std::shared_ptr<memoryPage>>;
 
-constexpr uint16_t MEMORY_SIZE = 4096;		// Chip-8 RAM is 4kB (address 0x000 (0) to 0xFFF (4095))
+// per address counters shown in the heatmap view (address >> heat shift)
+using heatArray = std::array<uint32_t, HEAT_SIZE>;
+
+// lowers counters, so only recent activity stays visible (called every frame)
+inline void decayHeat(heatArray& heat) {
+	for (uint32_t& value : heat) {
+		value -= (value + (1 << HEAT_DECAY_SHIFT) - 1) >> HEAT_DECAY_SHIFT;		// rounded up -> small values reach zero too
+	}
+}
 
 class ch8Memory {
 private:
-	std::array<uint8_t, MEMORY_SIZE> memory;
+	pageTable pages;		// size / PAGE_SIZE pages
+	mutable std::bitset<MEMORY_SIZE / PAGE_SIZE> ownPages;		// allocated here and never given to a fork - the only pages written in place
+	std::array<uint8_t*, MEMORY_SIZE / PAGE_SIZE> pageData{};		// content of the pages - one load less on every access
+	uint32_t size = CHIP8_MEMORY_SIZE;		// usable part of memory - accessing more is an error
+	heatArray writeHeat;		// recent writes to each address
+	uint8_t heatShift = 0;		// addresses per heatmap cell = 2^heatShift
+	uint64_t contentHash = 0;		// XOR of zobristKey(address, byte) of all bytes - kept up to date by every write
+
+	bool rangeFits(uint16_t pos, size_t length) const;
+	uint8_t& byteAt(uint16_t pos) const { return pageData[pos / PAGE_SIZE][pos % PAGE_SIZE]; }
+	memoryPage& writablePage(uint32_t page);		// copies the page first unless it's one of ownPages
 public:
 	ch8Memory();
-	void writeAtPos(uint16_t pos, uint8_t val);
+	void clear();		// zeros, heatmap too
+	void setSize(uint32_t newSize);		// power of two between CHIP8_MEMORY_SIZE and MEMORY_SIZE
+	uint32_t getSize() const { return size; }
+	uint8_t getHeatShift() const { return heatShift; }
+
+	// nothing throws - access outside of memory does nothing, reads give 0 and writes false (the core turns it into a fault)
+	bool writeAtPos(uint16_t pos, uint8_t val);
 	uint8_t readAtPos(uint16_t pos) const;
 	uint16_t readInstuctionAtPos(uint16_t pos) const;
-};
\ No newline at end of file
+	bool instructionFits(uint16_t pos) const { return pos + 1u < size; }
+
+	// bulk access - one check for the whole range, addresses past the end of the 64kB address space wrap around like above
+	// false (and nothing copied) when the range doesn't fit
+	bool write(uint16_t pos, std::span<const uint8_t> data);
+	bool read(uint16_t pos, std::span<uint8_t> out) const;
+
+	uint64_t getHash() const { return contentHash; }		// O(1), equal content = equal hash
+
+	// forks - the same pages as another memory of the same size, copy-on-write, so sharing costs one pointer per page
+	// a page given to a fork is never written again by anyone (this memory copies it before writing too), so the
+	// page table of a fork can be loaded by any number of memories on any threads at the same time
+	pageTable const& forkPages() const;		// this memory gives up its pages (see ownPages)
+	uint32_t getPageCount() const { return static_cast<uint32_t>(pages.size()); }
+	void sharePages(const pageTable& shared, uint64_t sharedHash);		// hash of the shared content (getHash of the memory they came from)
+
+	heatArray const& getWriteHeat() const { return writeHeat; }
+	void decayWriteHeat() { decayHeat(writeHeat); }
+};
+
+// reads are inline - fetching every instruction goes through them
+
+// read one byte from memory
+inline uint8_t ch8Memory::readAtPos(uint16_t pos) const {
+	if (pos >= size) return 0;
+	return byteAt(pos);
+}
+
+// read two bytes from memory (one instruction)
+inline uint16_t ch8Memory::readInstuctionAtPos(uint16_t pos) const {
+	if (!instructionFits(pos)) return 0;
+	if (pos % PAGE_SIZE == PAGE_SIZE - 1) return (byteAt(pos) << 8) | byteAt(pos + 1);		// the two bytes are on different pages
+
+	const uint8_t* bytes = &byteAt(pos);
+	uint16_t instruction = (bytes[0] << 8) | bytes[1];
+	return instruction;
+}
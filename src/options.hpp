@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// CHIP-8 variant the ROM was written for
+enum class ch8Platform {
+	CHIP8,
+	SCHIP,		// SUPER-CHIP
+	XOCHIP,		// 64kB memory
+};
+
+// keyboard layout of the keypad (see keymap.hpp)
+enum class ch8Keymap {
+	DEFAULT,	// 4x4 block on the left side of the keyboard
+	ARROWS,		// arrow keys replace 5, 7, 8 and 9 (up, left, down, right in most Octo games)
+};
+
+// settings of one emulator run - filled from command line arguments in chip8emu.cpp
+struct ch8Options {
+	int scale = 16;						// modifies size of the window
+	int speed = 840;					// instructions per second
+	bool autoSpeed = false;				// adjust speed to the game while it runs (see ch8SpeedTuner)
+	ch8Platform platform = ch8Platform::CHIP8;
+	ch8Keymap keymap = ch8Keymap::DEFAULT;
+	bool enableExplanations = false;	// show instruction explanations at the bottom
+	unsigned int mainColor = 0xffcc01FF;	// color of displayed pixels
+	unsigned int BGColor = 0x996700FF;		// color of background pixels
+
+	bool enableFusion = true;			// execute common instruction sequences as one fused operation
+	bool enableCompiled = true;			// run ROMs translated by ch8aot as native code (when linked into the emulator)
+	bool enableProfiling = false;		// print execution statistics when the emulator exits
+	std::string tracePath;				// write every executed instruction to this file (empty = no trace)
+
+	int renderFPS = 0;					// limit of presented frames per second (0 = refresh rate of the monitor)
+	bool measureLatency = false;		// report time from keypress to the frame showing it
+	int runAhead = 0;					// frames emulated ahead of the real state before showing them (hides input lag of games)
+
+	// platform, speed and keymap of known ROMs are taken from this file, unless they were given on the command line (see romdb.hpp)
+	std::string romDatabasePath = "romdb.txt";		// relative to the current directory, empty = not used
+	bool platformGiven = false;
+	bool speedGiven = false;
+	bool keymapGiven = false;
+
+	// headless mode - runs many ROMs without a window (see runner.hpp)
+	bool headless = false;
+	int frames = 600;					// frames emulated in every run (600 = 10 seconds)
+	uint64_t maxInstructions = 0;		// a run also ends after this many instructions (0 = only the frame limit)
+	bool stopOnHalt = true;				// end runs (and environment episodes) once the program halted (see chip8::checkHalted)
+	bool requireHalt = false;			// a run which reaches a limit without halting failed (test ROMs which never finish)
+	std::string inputPath;				// input script used for every ROM (empty = ROM name with .input extension, if it exists)
+	int threads = 0;					// 0 = one per hardware thread
+	uint32_t seed = 0;					// random numbers of every run start from this seed -> same results every time
+	int batchLanes = 0;					// run every ROM on a ch8Batch of this many lanes and compare them with separate cores (0 = normal runs)
+};
\ No newline at end of file
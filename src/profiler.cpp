@@ -0,0 +1,68 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <iomanip>
+
+using namespace std;
+
+ch8Profiler::ch8Profiler(vector<string> names)
+	: kindNames(move(names))
+{
+	kindCounts.fill(0);
+	sampleCounts.fill(0);
+	sampledTime.fill(chrono::nanoseconds::zero());
+	addressCounts.fill(0);
+}
+
+void ch8Profiler::report(ostream& out, const ch8Memory& memory) const {
+	uint64_t total = accumulate(kindCounts.begin(), kindCounts.end(), uint64_t{ 0 });
+	if (total == 0) {
+		out << "Profiler: nothing was executed yet." << endl;
+		return;
+	}
+
+	// average time of one dispatch of each kind, kinds without samples use the overall average
+	uint64_t allSamples = accumulate(sampleCounts.begin(), sampleCounts.end(), uint64_t{ 0 });
+	chrono::nanoseconds allTime = accumulate(sampledTime.begin(), sampledTime.end(), chrono::nanoseconds::zero());
+	double averageTime = (allSamples != 0) ? static_cast<double>(allTime.count()) / allSamples : 1.0;
+
+	array<double, PROFILER_MAX_KINDS> estimatedTime;
+	for (size_t kind = 0; kind < kindNames.size(); ++kind) {
+		double kindAverage = (sampleCounts[kind] != 0) ? static_cast<double>(sampledTime[kind].count()) / sampleCounts[kind] : averageTime;
+		estimatedTime[kind] = kindAverage * kindCounts[kind];
+	}
+	double totalTime = accumulate(estimatedTime.begin(), estimatedTime.begin() + kindNames.size(), 0.0);
+
+	// opcodes sorted by execution count
+	vector<size_t> kinds(kindNames.size());
+	iota(kinds.begin(), kinds.end(), 0);
+	sort(kinds.begin(), kinds.end(), [this](size_t a, size_t b) { return kindCounts[a] > kindCounts[b]; });
+
+	out << fixed << setprecision(2);
+	out << "Opcode histogram (" << total << " dispatches, " << allSamples << " timed):" << endl;
+	out << "  " << left << setw(24) << "opcode" << right << setw(14) << "count" << setw(9) << "%" << setw(9) << "time %" << endl;
+	for (size_t kind : kinds) {
+		if (kindCounts[kind] == 0) break;
+		out << "  " << left << setw(24) << kindNames[kind] << right << setw(14) << kindCounts[kind]
+			<< setw(9) << 100.0 * kindCounts[kind] / total << setw(9) << ((totalTime > 0) ? 100.0 * estimatedTime[kind] / totalTime : 0.0) << endl;
+	}
+
+	// hottest addresses (start of the executed instruction or sequence)
+	vector<uint16_t> addresses(MEMORY_SIZE);
+	iota(addresses.begin(), addresses.end(), 0);
+	partial_sort(addresses.begin(), addresses.begin() + PROFILER_TOP_ADDRESSES, addresses.end(),
+		[this](uint16_t a, uint16_t b) { return addressCounts[a] > addressCounts[b]; });
+
+	out << "Hottest addresses:" << endl;
+	for (int i = 0; i < PROFILER_TOP_ADDRESSES; ++i) {
+		uint16_t address = addresses[i];
+		if (addressCounts[address] == 0) break;
+
+		out << "  0x" << hex << uppercase << setfill('0') << setw(3) << address << " (" << setw(4);
+		if (address + 1u < memory.getSize()) out << memory.readInstuctionAtPos(address);
+		else out << "----";
+		out << ")" << dec << setfill(' ') << setw(14) << addressCounts[address] << setw(9) << 100.0 * addressCounts[address] / total << endl;
+	}
+	out << defaultfloat << flush;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "memory.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+constexpr int PROFILER_MAX_KINDS = 64;				// max number of distinct dispatch kinds (opcodes + fused sequences)
+constexpr uint64_t PROFILER_SAMPLE_INTERVAL = 256;	// every n-th dispatch gets timed (must be a power of two)
+constexpr int PROFILER_TOP_ADDRESSES = 16;			// number of hottest addresses in the report
+
+// counts executed dispatches per kind and per address, estimates time spent in each kind by sampling
+class ch8Profiler {
+private:
+	std::vector<std::string> kindNames;
+	std::array<uint64_t, PROFILER_MAX_KINDS> kindCounts;
+	std::array<uint64_t, PROFILER_MAX_KINDS> sampleCounts;
+	std::array<std::chrono::nanoseconds, PROFILER_MAX_KINDS> sampledTime;
+	std::array<uint64_t, MEMORY_SIZE> addressCounts;
+	uint64_t dispatches = 0;
+
+public:
+	explicit ch8Profiler(std::vector<std::string> names);
+
+	// called for every dispatch while profiling
+	void count(uint16_t address, uint8_t kind) {
+		++kindCounts[kind];
+		++addressCounts[address];
+	}
+
+	// true for every PROFILER_SAMPLE_INTERVAL-th dispatch -> caller should time it and call addSample
+	bool shouldSample() {
+		return (++dispatches & (PROFILER_SAMPLE_INTERVAL - 1)) == 0;
+	}
+
+	void addSample(uint8_t kind, std::chrono::nanoseconds duration) {
+		++sampleCounts[kind];
+		sampledTime[kind] += duration;
+	}
+
+	// prints sorted histograms, memory is used to show the instructions at the hottest addresses
+	void report(std::ostream& out, const ch8Memory& memory) const;
+};
\ No newline at end of file
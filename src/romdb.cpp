@@ -0,0 +1,106 @@
+#include "romdb.hpp"
+
+#include "framebuffer.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+uint64_t hashROM(span<const uint8_t> rom) {
+	uint64_t value = FNV_OFFSET_BASIS;
+	for (uint8_t byte : rom) {
+		value ^= byte;
+		value *= FNV_PRIME;
+	}
+	return value;
+}
+
+uint64_t hashROMFile(const string& romPath) {
+	ifstream file(romPath, ios::binary);
+	if (!file.good()) throw runtime_error("Couldn't load ROM file!");
+	vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	return hashROM(rom);
+}
+
+namespace {
+	bool parsePlatform(const string& field, ch8RomInfo& info) {
+		if (field == "-") return true;
+		info.hasPlatform = true;
+		if (field == "chip8") info.platform = ch8Platform::CHIP8;
+		else if (field == "schip") info.platform = ch8Platform::SCHIP;
+		else if (field == "xochip") info.platform = ch8Platform::XOCHIP;
+		else return false;
+		return true;
+	}
+
+	bool parseKeymap(const string& field, ch8RomInfo& info) {
+		if (field == "-") return true;
+		info.hasKeymap = true;
+		if (field == "default") info.keymap = ch8Keymap::DEFAULT;
+		else if (field == "arrows") info.keymap = ch8Keymap::ARROWS;
+		else return false;
+		return true;
+	}
+}
+
+ch8RomDatabase::ch8RomDatabase(const string& fileName) {
+	ifstream file(fileName);
+	if (!file.good()) return;
+
+	string line;
+	while (getline(file, line)) {
+		line = line.substr(0, line.find('#'));
+
+		istringstream fields(line);
+		string hash, platform, speed, keymap;
+		if (!(fields >> hash)) continue;		// empty line
+		if (!(fields >> platform >> speed >> keymap)) throw runtime_error("Invalid ROM database line: " + line);
+
+		ch8RomInfo info;
+		getline(fields >> ws, info.name);
+
+		size_t parsed = 0;
+		uint64_t key;
+		try {
+			key = stoull(hash, &parsed, 16);
+			if (speed != "-") info.speed = stoi(speed);
+		}
+		catch (const logic_error&) {		// invalid_argument and out_of_range
+			throw runtime_error("Invalid ROM database line: " + line);
+		}
+		if (parsed != hash.size() || info.speed < 0 || !parsePlatform(platform, info) || !parseKeymap(keymap, info)) {
+			throw runtime_error("Invalid ROM database line: " + line);
+		}
+
+		entries[key] = info;
+	}
+}
+
+const ch8RomInfo* ch8RomDatabase::find(uint64_t hash) const {
+	auto it = entries.find(hash);
+	return (it != entries.end()) ? &it->second : nullptr;
+}
+
+const ch8RomInfo* ch8RomDatabase::find(const string& romPath) const {
+	if (entries.empty()) return nullptr;
+
+	try {
+		return find(hashROMFile(romPath));
+	}
+	catch (const runtime_error&) {
+		return nullptr;		// loading the ROM reports it
+	}
+}
+
+const ch8RomInfo* ch8RomDatabase::apply(const string& romPath, ch8Options& options) const {
+	const ch8RomInfo* info = find(romPath);
+	if (!info) return nullptr;
+
+	if (info->hasPlatform && !options.platformGiven) options.platform = info->platform;
+	if (info->speed > 0 && !options.speedGiven) options.speed = info->speed;
+	if (info->hasKeymap && !options.keymapGiven) options.keymap = info->keymap;
+	return info;
+}
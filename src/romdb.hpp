@@ -0,0 +1,40 @@
+#pragma once
+
+#include "options.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+// settings of one known ROM - every field is optional (- in the database file)
+struct ch8RomInfo {
+	std::string name;				// only for messages, ROMs are found by their content
+	bool hasPlatform = false;
+	ch8Platform platform = ch8Platform::CHIP8;		// decides quirks (skips over F000 NNNN) and memory size
+	int speed = 0;					// instructions per second (0 = not known)
+	bool hasKeymap = false;
+	ch8Keymap keymap = ch8Keymap::DEFAULT;
+};
+
+// 64-bit FNV-1a of the whole ROM file
+uint64_t hashROM(std::span<const uint8_t> rom);
+uint64_t hashROMFile(const std::string& romPath);
+
+// known ROMs by the hash of their content, loaded from a text file (romdb.txt in the current directory by default, see ch8Options)
+// every non-empty line is "hash platform speed keymap name", - leaves a field unset and # starts a comment:
+// eb3d7531568a1c9a chip8 10000 arrows tank.ch8
+class ch8RomDatabase {
+private:
+	std::unordered_map<uint64_t, ch8RomInfo> entries;
+
+public:
+	explicit ch8RomDatabase(const std::string& fileName);		// missing file = empty database
+
+	const ch8RomInfo* find(uint64_t hash) const;
+	const ch8RomInfo* find(const std::string& romPath) const;		// null for unknown and unreadable ROMs
+
+	// fills settings the user didn't give on the command line, returns the ROM that was found (or null)
+	const ch8RomInfo* apply(const std::string& romPath, ch8Options& options) const;
+	size_t size() const { return entries.size(); }
+};
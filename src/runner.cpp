@@ -0,0 +1,278 @@
+#include "runner.hpp"
+
+#include "batch.hpp"
+#include "chip8.hpp"
+#include "romdb.hpp"
+#include "scheduler.hpp"
+#include "workpool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>		// enables setfill() and setw() to pad numbers with zeros
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// every non-empty line is "frame keys", keys are hex digits of held keypad keys or - for none, # starts a comment:
+// 0 -
+// 120 5
+// 125 -
+vector<ch8InputEvent> loadInputScript(const string& fileName) {
+	ifstream file(fileName);
+	if (!file.good()) throw runtime_error("Couldn't load input script!");
+
+	vector<ch8InputEvent> events;
+	string line;
+	while (getline(file, line)) {
+		line = line.substr(0, line.find('#'));
+
+		istringstream fields(line);
+		int frame;
+		string keys;
+		if (!(fields >> frame)) continue;		// empty line
+		if (!(fields >> keys) || frame < 0) throw runtime_error("Invalid input script!");
+
+		uint16_t held = 0;
+		if (keys != "-") {
+			for (char key : keys) {
+				if (!isxdigit(static_cast<unsigned char>(key))) throw runtime_error("Invalid input script!");
+				held |= 1 << stoi(string(1, key), nullptr, 16);
+			}
+		}
+		events.push_back({ frame, held });
+	}
+
+	// lines may be in any order
+	stable_sort(events.begin(), events.end(), [](const ch8InputEvent& a, const ch8InputEvent& b) { return a.frame < b.frame; });
+	return events;
+}
+
+namespace {
+	bool isROMFile(const fs::path& path) {
+		string extension = path.extension().string();
+		return extension == ".ch8" || extension == ".sc8" || extension == ".xo8";
+	}
+
+	// script given by --input, otherwise one named like the ROM (game.ch8 -> game.input)
+	string inputFor(const fs::path& romPath, const ch8Options& options) {
+		if (!options.inputPath.empty()) return options.inputPath;
+
+		fs::path script = romPath;
+		script.replace_extension(".input");
+		return fs::exists(script) ? script.string() : "";
+	}
+}
+
+vector<ch8Job> collectJobs(const vector<string>& paths, const ch8Options& options) {
+	vector<fs::path> romPaths;
+	for (const string& path : paths) {
+		if (fs::is_directory(path)) {
+			for (const fs::directory_entry& entry : fs::recursive_directory_iterator(path)) {
+				if (entry.is_regular_file() && isROMFile(entry.path())) romPaths.push_back(entry.path());
+			}
+		}
+		else {
+			romPaths.push_back(path);		// missing files are reported as failed jobs
+		}
+	}
+	sort(romPaths.begin(), romPaths.end());
+
+	vector<ch8Job> jobs;
+	for (const fs::path& romPath : romPaths) {
+		jobs.push_back({ romPath.string(), inputFor(romPath, options), options.frames });
+	}
+	return jobs;
+}
+
+ch8JobResult runJob(const ch8Options& options, const ch8Job& job, ch8CorePool& cores) {
+	ch8JobResult result;
+	unique_ptr<chip8> core = cores.acquire(options);
+
+	try {
+		vector<ch8InputEvent> script;
+		if (!job.inputPath.empty()) script = loadInputScript(job.inputPath);
+		core->loadROM(job.romPath);
+		core->seedRandom(options.seed);
+
+		// same number of instructions in every frame as when running in the window
+		ch8Scheduler scheduler(options.speed);
+		unique_ptr<ch8SpeedTuner> speedTuner = options.autoSpeed ? make_unique<ch8SpeedTuner>(options.speed) : nullptr;
+		size_t nextEvent = 0;
+		uint16_t held = 0;
+		for (; result.frames < job.frames; ++result.frames) {
+			uint16_t previous = held;
+			while (nextEvent < script.size() && script[nextEvent].frame <= result.frames) held = script[nextEvent++].held;
+
+			core->setKeypad(held, held & ~previous);
+			int IPC = scheduler.instructionsForTick();
+			if (core->emulateOneFrame(IPC) != ch8Fault::NONE) {
+				result.error = core->describeFault();
+				break;
+			}
+			if (speedTuner) scheduler.setSpeed(speedTuner->update(IPC, core->getIdleInstructions()));
+
+			// a halted program would only repeat the same frame, the instruction limit is a watchdog for ROMs which never settle
+			bool outOfInstructions = options.maxInstructions > 0 && core->getInstructionCount() >= options.maxInstructions;
+			if ((options.stopOnHalt && core->isHalted()) || outOfInstructions) {
+				++result.frames;
+				break;
+			}
+		}
+
+		result.halted = core->isHalted() && result.error.empty();
+		if (options.requireHalt && !result.halted && result.error.empty()) {
+			result.error = "Watchdog: didn't halt in " + to_string(result.frames) + " frames (" + to_string(core->getInstructionCount()) + " instructions)";
+		}
+	}
+	catch (const runtime_error& error) {
+		result.error = error.what();
+	}
+
+	result.instructions = core->getInstructionCount();
+	result.frameHash = core->getFrameBuffer().hash();
+	cores.release(move(core));
+	return result;
+}
+
+namespace {
+	// empty when the lane and the core are in the same state
+	string compareLane(const ch8Batch& batch, int lane, const chip8& core) {
+		ch8Registers batchRegisters = batch.getRegisters(lane);
+		ch8Registers coreRegisters = core.getRegisters();
+		if (batch.isFaulted(lane) != (core.getFault() != ch8Fault::NONE)) return "fault";
+		if (batch.isFaulted(lane) && batch.getError(lane) != core.describeFault()) return "fault";
+		if (batchRegisters.regPC != coreRegisters.regPC || batchRegisters.regI != coreRegisters.regI || batchRegisters.regsVx != coreRegisters.regsVx
+			|| batchRegisters.regDT != coreRegisters.regDT || batchRegisters.regST != coreRegisters.regST || batchRegisters.regSP != coreRegisters.regSP
+			|| batchRegisters.stack != coreRegisters.stack) return "registers";
+		if (batch.getFrameBuffer(lane).hash() != core.getFrameBuffer().hash()) return "screen";
+		return "";
+	}
+}
+
+ch8JobResult runBatchJob(const ch8Options& options, const ch8Job& job, ch8CorePool& cores) {
+	ch8JobResult result;
+	int lanes = options.batchLanes;
+	vector<unique_ptr<chip8>> laneCores;
+	unique_ptr<ch8Batch> batchHolder;
+
+	try {
+		vector<ch8InputEvent> script;
+		if (!job.inputPath.empty()) script = loadInputScript(job.inputPath);
+
+		batchHolder = make_unique<ch8Batch>(options, lanes, options.seed);
+		ch8Batch& batch = *batchHolder;
+		batch.loadROM(job.romPath);
+		for (int lane = 0; lane < lanes; ++lane) {
+			laneCores.push_back(cores.acquire(options));
+			laneCores[lane]->loadROM(job.romPath);
+			laneCores[lane]->seedRandom(options.seed + lane);
+		}
+
+		ch8Scheduler scheduler(options.speed);
+		size_t nextEvent = 0;
+		uint16_t held = 0;
+		for (; result.frames < job.frames; ++result.frames) {
+			uint16_t previous = held;
+			while (nextEvent < script.size() && script[nextEvent].frame <= result.frames) held = script[nextEvent++].held;
+
+			int IPC = scheduler.instructionsForTick();
+			for (int lane = 0; lane < lanes; ++lane) batch.setKeypad(lane, held, held & ~previous);
+			batch.emulateOneFrame(IPC);
+			bool running = false, allHalted = true;
+			for (int lane = 0; lane < lanes; ++lane) {
+				chip8& core = *laneCores[lane];
+				if (core.getFault() == ch8Fault::NONE) {
+					core.setKeypad(held, held & ~previous);
+					core.emulateOneFrame(IPC);
+				}
+				string difference = compareLane(batch, lane, core);
+				if (!difference.empty()) {
+					throw runtime_error("Batch lane " + to_string(lane) + " differs from its core (" + difference + ") in frame " + to_string(result.frames));
+				}
+				running |= !batch.isFaulted(lane);
+				allHalted &= batch.isHalted(lane) || batch.isFaulted(lane);
+			}
+
+			// the first fault is reported, the rest of the lanes are checked until the end anyway
+			if (result.error.empty()) {
+				for (int lane = 0; lane < lanes; ++lane) {
+					if (batch.isFaulted(lane)) {
+						result.error = "lane " + to_string(lane) + ": " + batch.getError(lane);
+						break;
+					}
+				}
+			}
+
+			if (!running || (options.stopOnHalt && allHalted)) {
+				++result.frames;
+				break;
+			}
+		}
+
+		result.halted = batch.isHalted(0) && result.error.empty();
+	}
+	catch (const runtime_error& error) {
+		result.error = error.what();
+	}
+
+	if (batchHolder) {
+		result.instructions = batchHolder->getLockstepInstructions() + batchHolder->getLaneInstructions();
+		result.lockstepInstructions = batchHolder->getLockstepInstructions();
+		result.frameHash = batchHolder->getFrameBuffer(0).hash();
+	}
+
+	for (unique_ptr<chip8>& core : laneCores) cores.release(move(core));
+	return result;
+}
+
+int runHeadless(const ch8Options& options, const vector<string>& paths) {
+	// jobs run at the same time -> nothing that would be shared between them or flood the console
+	ch8Options jobOptions = options;
+	jobOptions.enableExplanations = false;
+	jobOptions.enableProfiling = false;
+	jobOptions.tracePath.clear();
+
+	vector<ch8Job> jobs = collectJobs(paths, jobOptions);
+	vector<ch8JobResult> results(jobs.size());
+	ch8RomDatabase database(options.romDatabasePath);
+
+	auto start = chrono::steady_clock::now();
+	ch8CorePool cores;		// a few cores per thread are enough for any number of jobs
+	ch8WorkPool pool(static_cast<unsigned>(max(0, options.threads)));
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		pool.submit([&jobOptions, &database, &cores, &jobs, &results, i] {
+			ch8Options romOptions = jobOptions;		// known ROMs run with their own platform and speed
+			database.apply(jobs[i].romPath, romOptions);
+			results[i] = (romOptions.batchLanes > 0) ? runBatchJob(romOptions, jobs[i], cores) : runJob(romOptions, jobs[i], cores);
+		});
+	}
+	pool.wait();
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	// results are printed in the order of jobs, so outputs of two runs can be compared line by line
+	int failed = 0;
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		const ch8JobResult& result = results[i];
+		cout << jobs[i].romPath << "\t" << result.frames << " frames\t" << result.instructions << " instructions\t"
+			<< hex << setfill('0') << setw(16) << result.frameHash << dec << setfill(' ') << "\t";
+		if (options.batchLanes > 0 && result.instructions > 0) {
+			cout << fixed << setprecision(1) << 100.0 * result.lockstepInstructions / result.instructions << "% lockstep\t" << defaultfloat;
+		}
+		if (result.error.empty()) {
+			cout << (result.halted ? "Halted" : "OK") << endl;
+		}
+		else {
+			cout << "Error: " << result.error << endl;
+			++failed;
+		}
+	}
+
+	cout << jobs.size() << " runs, " << failed << " failed, " << fixed << setprecision(2) << elapsed.count() << " s on " << pool.size() << " threads" << endl;
+	return (failed > 0) ? 1 : 0;
+}
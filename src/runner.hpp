@@ -0,0 +1,44 @@
+#pragma once
+
+#include "options.hpp"
+#include "corepool.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// one headless run of a ROM
+struct ch8Job {
+	std::string romPath;
+	std::string inputPath;		// empty = no keys are pressed
+	int frames;
+};
+
+struct ch8JobResult {
+	int frames = 0;				// frames finished before the end or an error
+	uint64_t instructions = 0;
+	uint64_t frameHash = 0;		// hash of the screen at the end (see ch8FrameBuffer::hash)
+	bool halted = false;		// the program can't continue any more (see chip8::checkHalted)
+	std::string error;			// empty when the run finished
+	uint64_t lockstepInstructions = 0;		// batch runs - part of instructions executed for all lanes at once
+};
+
+// line of an input script - keys held from the given frame on
+struct ch8InputEvent {
+	int frame;
+	uint16_t held;		// bit n is keypad key n
+};
+
+std::vector<ch8InputEvent> loadInputScript(const std::string& fileName);
+
+// ROM files and directories (searched recursively for .ch8, .sc8 and .xo8 files) to jobs sorted by path
+std::vector<ch8Job> collectJobs(const std::vector<std::string>& paths, const ch8Options& options);
+
+ch8JobResult runJob(const ch8Options& options, const ch8Job& job, ch8CorePool& cores);		// core comes from the pool and goes back
+
+// same run on options.batchLanes lanes of a ch8Batch (lane i seeded with seed + i, all get the same keys), every frame each lane
+// is compared with a separate core seeded the same way - a difference is an error, counts and hash are those of all lanes / lane 0
+ch8JobResult runBatchJob(const ch8Options& options, const ch8Job& job, ch8CorePool& cores);
+
+// runs all jobs on a work stealing pool without any window and prints one line per job - returns 1 when any of them failed
+int runHeadless(const ch8Options& options, const std::vector<std::string>& paths);
@@ -0,0 +1,80 @@
+#include "scheduler.hpp"
+#include "state.hpp"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+ch8Scheduler::ch8Scheduler(int speed)
+	: speed(speed)
+	, tickDuration(chrono::duration_cast<clock::duration>(chrono::duration<double>(1.0 / STANDARD_FPS)))
+	, lastUpdate(clock::now())
+{
+	accumulator = tickDuration;		// run the first tick right away
+}
+
+int ch8Scheduler::ticksDue() {
+	clock::time_point now = clock::now();
+	accumulator += now - lastUpdate;
+	lastUpdate = now;
+
+	int64_t ticks = accumulator / tickDuration;
+	accumulator -= ticks * tickDuration;
+
+	// after a stall (e.g. window being dragged) only catch up a little, the rest of the time is skipped
+	if (ticks > MAX_CATCHUP_TICKS) {
+		droppedTicks += ticks - MAX_CATCHUP_TICKS;
+		ticks = MAX_CATCHUP_TICKS;
+	}
+
+	return static_cast<int>(ticks);
+}
+
+int ch8Scheduler::instructionsForTick() {
+	instructionRemainder += speed;
+	int instructions = static_cast<int>(instructionRemainder / STANDARD_FPS);
+	instructionRemainder %= STANDARD_FPS;
+
+	return instructions;
+}
+
+int ch8Scheduler::instructionsAhead(int ticks) const {
+	int64_t before = instructionRemainder + static_cast<int64_t>(speed) * ticks;
+	return static_cast<int>((before + speed) / STANDARD_FPS - before / STANDARD_FPS);
+}
+
+void ch8Scheduler::sleepUntilNextTick() const {
+	this_thread::sleep_until(lastUpdate + (tickDuration - accumulator));
+}
+
+void ch8Scheduler::restart() {
+	lastUpdate = clock::now();
+	accumulator = clock::duration::zero();
+}
+
+int ch8SpeedTuner::update(int executed, int idle) {
+	if (executed == 0) return speed;		// speeds below 60 have empty frames
+
+	++frames;
+	if (idle == 0) ++framesWithoutIdle;
+	maxBusy = max(maxBusy, executed - idle);
+	if (frames < AUTO_SPEED_WINDOW) return speed;
+
+	if (framesWithoutIdle == AUTO_SPEED_WINDOW) {
+		// no waiting at all - the game doesn't pace itself (or is busy polling keys), nothing to measure
+	}
+	else if (framesWithoutIdle * 10 > AUTO_SPEED_WINDOW) {
+		speed = min(AUTO_SPEED_MAX, speed * 3 / 2);
+	}
+	else if (framesWithoutIdle == 0) {
+		// only lowered when it saves something, so the speed doesn't jump back and forth
+		int target = clamp(maxBusy * STANDARD_FPS * 5 / 4, AUTO_SPEED_MIN, AUTO_SPEED_MAX);
+		if (target * 10 < speed * 9) speed = target;
+	}
+
+	frames = 0;
+	framesWithoutIdle = 0;
+	maxBusy = 0;
+	return speed;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "state.hpp"
+
+#include <chrono>
+#include <cstdint>
+
+constexpr int MAX_CATCHUP_TICKS = 4;		// ticks run back to back after a stall, older ones are dropped
+
+// automatic speed (see ch8SpeedTuner)
+constexpr int AUTO_SPEED_MIN = 600;			// 10 instructions per frame
+constexpr int AUTO_SPEED_MAX = 30000;
+constexpr int AUTO_SPEED_WINDOW = 30;		// frames between adjustments (half a second)
+
+// decides when to run emulated frames (ticks) - exactly STANDARD_FPS ticks and speed instructions per second of host time
+class ch8Scheduler {
+private:
+	using clock = std::chrono::steady_clock;
+
+	int speed;							// instructions per second
+	clock::duration tickDuration;
+	clock::time_point lastUpdate;
+	clock::duration accumulator{};		// host time not yet covered by ticks
+	int64_t instructionRemainder = 0;	// fraction of instruction carried to the next tick (in 1/STANDARD_FPS units)
+	uint64_t droppedTicks = 0;
+
+public:
+	explicit ch8Scheduler(int speed);
+
+	// adds host time passed since the last call, returns number of ticks to run now (at most MAX_CATCHUP_TICKS)
+	int ticksDue();
+
+	// instructions to execute in the next tick - spreads speed evenly, so every second has exactly speed instructions
+	int instructionsForTick();
+	int instructionsAhead(int ticks) const;		// what instructionsForTick will return after the given number of ticks
+
+	// same sequence without a scheduler object - instructions in the tick with the given number (counted from 0)
+	static int instructionsInTick(int speed, uint64_t tick) {
+		return static_cast<int>(((tick + 1) * speed) / STANDARD_FPS - (tick * speed) / STANDARD_FPS);
+	}
+
+	void sleepUntilNextTick() const;
+
+	// forget time passed while emulation wasn't running (paused)
+	void restart();
+
+	uint64_t getDroppedTicks() const { return droppedTicks; }
+
+	int getSpeed() const { return speed; }
+	void setSpeed(int newSpeed) { speed = newSpeed; }
+};
+
+// finds the lowest speed at which a game still waits for its timer (or a key) in every frame
+// games that wait only in some frames get faster, games that mostly wait get slower (keeping a quarter of a frame spare)
+// and games that don't wait at all keep their speed
+class ch8SpeedTuner {
+private:
+	int speed;
+	int frames = 0;
+	int framesWithoutIdle = 0;		// whole frame was work -> the game may be too slow
+	int maxBusy = 0;				// most instructions of work in one frame
+
+public:
+	explicit ch8SpeedTuner(int speed) : speed(speed) {}
+
+	// called after every frame with its instructions and how many of them were waiting (chip8::getIdleInstructions), returns speed for the next frames
+	int update(int executed, int idle);
+	int getSpeed() const { return speed; }
+};
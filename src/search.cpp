@@ -0,0 +1,358 @@
+#include "chip8.hpp"
+#include "corepool.hpp"
+#include "scheduler.hpp"
+#include "workpool.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+// Searches keypad input sequences of a ROM breadth-first (bots, tool-assisted runs, finding soft-locks and score bugs).
+// Every state of one depth is continued with every action (no key or one held key) for a few frames, states seen
+// before are dropped by their hash (see chip8::hashState), so the search spreads over different situations of the game
+// instead of repeating the same ones. States are forks (see ch8ForkState), sharing unchanged memory pages.
+// Reports the first fault, the first state no input changes any more and the highest score read from memory,
+// each with an input script reproducing it in the emulator (--input).
+namespace {
+    constexpr int SET_SHARDS = 64;
+    constexpr size_t NODES_PER_TASK = 64;
+
+    // hashes of all states seen so far - split into shards with their own locks, so threads rarely wait for each other
+    class stateSet {
+    private:
+        struct shard {
+            mutex lock;
+            unordered_set<uint64_t> hashes;
+        };
+        array<shard, SET_SHARDS> shards;
+
+    public:
+        bool insert(uint64_t hash) {        // false when the state was seen before
+            shard& target = shards[hash >> 58];     // top bits, the sets themselves use the low ones
+            lock_guard<mutex> guard(target.lock);
+            return target.hashes.insert(hash).second;
+        }
+
+        bool contains(uint64_t hash) {
+            shard& target = shards[hash >> 58];
+            lock_guard<mutex> guard(target.lock);
+            return target.hashes.contains(hash);
+        }
+
+        size_t size() {
+            size_t total = 0;
+            for (shard& s : shards) {
+                lock_guard<mutex> guard(s.lock);
+                total += s.hashes.size();
+            }
+            return total;
+        }
+    };
+
+    struct settings {
+        string romPath;
+        ch8Options options;
+        int depth = 30;
+        int stepFrames = 4;             // frames every action is held for
+        size_t width = 10000;           // states kept per depth, the rest is dropped
+        vector<uint16_t> actions;       // held keys (bit n is key n)
+        int scoreAddress = -1;          // -1 = no score
+        int scoreBytes = 1;             // big endian
+        int64_t goal = -1;              // stop once the score reaches it (-1 = never)
+        string savePrefix;              // input scripts of the findings (empty = only printed)
+    };
+
+    // state reached at some depth
+    struct node {
+        ch8ForkState state;
+        uint64_t hash;
+        uint32_t parent;        // index at the previous depth
+        uint16_t action;
+    };
+
+    // how every state was reached, kept for all depths (states themselves only for the last one)
+    struct pathStep {
+        uint32_t parent;
+        uint16_t action;
+    };
+
+    // something worth reporting - the action of a state at some depth led to it
+    struct finding {
+        bool found = false;
+        int depth = 0;
+        uint32_t index = 0;
+        uint16_t action = 0;
+        int64_t score = -1;
+        string message;
+        size_t count = 0;
+
+        // keeps the first one (lowest depth, then lowest index - same as with one thread)
+        void add(const finding& other) {
+            count += other.count;
+            if (other.found && !found) {
+                size_t total = count;
+                *this = other;
+                count = total;
+            }
+        }
+    };
+
+    struct chunkResult {
+        vector<node> nodes;
+        finding fault;
+        finding stuck;
+        finding best;
+        uint64_t expanded = 0;
+    };
+
+    string keysText(uint16_t held) {
+        if (held == 0) return "-";
+        string text;
+        for (int key = 0; key < KEYPAD_KEYS; ++key) {
+            if (held & (1 << key)) text += "0123456789ABCDEF"[key];
+        }
+        return text;
+    }
+
+    int64_t readScore(const chip8& core, const settings& config) {
+        if (config.scoreAddress < 0) return -1;
+        int64_t score = 0;
+        for (int i = 0; i < config.scoreBytes; ++i) score = (score << 8) | core.peekMemory(static_cast<uint16_t>(config.scoreAddress + i));
+        return score;
+    }
+
+    // every action of the given states, states not seen at earlier depths go to the result
+    // (seen is only read here - states new in this depth are inserted by the in-order merge, see main)
+    void expand(const settings& config, ch8CorePool& cores, const vector<node>& layer, size_t first, size_t last, int depth, stateSet& seen, chunkResult& result) {
+        unique_ptr<chip8> core = cores.acquire(config.options);
+        uint64_t frame = static_cast<uint64_t>(depth) * config.stepFrames;
+        unordered_set<uint64_t> reached;        // states of this chunk, other chunks may reach them too
+
+        for (size_t i = first; i < last; ++i) {
+            const node& from = layer[i];
+            size_t unchanged = 0;
+
+            for (uint16_t action : config.actions) {
+                core->loadFork(from.state);
+                ch8Fault fault = ch8Fault::NONE;
+                for (int f = 0; f < config.stepFrames && fault == ch8Fault::NONE; ++f) {
+                    core->setKeypad(action, (f == 0) ? (action & ~from.state.keypadHeld) : 0);      // pressed only in the first frame (like input scripts)
+                    fault = core->emulateOneFrame(ch8Scheduler::instructionsInTick(config.options.speed, frame + f));
+                }
+                ++result.expanded;
+
+                if (fault != ch8Fault::NONE) {
+                    ++result.fault.count;
+                    if (!result.fault.found) result.fault = { true, depth, static_cast<uint32_t>(i), action, -1, core->describeFault(), result.fault.count };
+                    continue;
+                }
+
+                uint64_t hash = core->hashState();
+                if (hash == from.hash) ++unchanged;
+                if (seen.contains(hash) || !reached.insert(hash).second) continue;
+
+                int64_t score = readScore(*core, config);
+                if (score > result.best.score) result.best = { true, depth, static_cast<uint32_t>(i), action, score, "", 0 };
+
+                result.nodes.push_back({ ch8ForkState(), hash, static_cast<uint32_t>(i), action });
+                core->saveFork(result.nodes.back().state);
+            }
+
+            if (unchanged == config.actions.size()) {
+                ++result.stuck.count;
+                if (!result.stuck.found) result.stuck = { true, depth, static_cast<uint32_t>(i), 0, -1, "", result.stuck.count };
+            }
+        }
+
+        cores.release(std::move(core));
+    }
+
+    // actions from the start to the given state
+    vector<uint16_t> inputsTo(const vector<vector<pathStep>>& history, int depth, uint32_t index) {
+        vector<uint16_t> inputs;
+        for (int d = depth; d > 0; --d) {
+            inputs.push_back(history[d][index].action);
+            index = history[d][index].parent;
+        }
+        reverse(inputs.begin(), inputs.end());
+        return inputs;
+    }
+
+    void report(const string& name, const finding& found, const vector<vector<pathStep>>& history, const settings& config, bool withAction) {
+        if (!found.found) {
+            cout << name << ": none" << endl;
+            return;
+        }
+
+        vector<uint16_t> inputs = inputsTo(history, found.depth, found.index);
+        if (withAction) inputs.push_back(found.action);
+
+        cout << name << ": " << found.message << (found.message.empty() ? "" : " ");
+        if (found.score >= 0) cout << "score " << found.score << " ";
+        if (found.count > 0) cout << "(" << found.count << " found) ";
+        cout << "after " << inputs.size() * config.stepFrames << " frames, keys:";
+        for (uint16_t held : inputs) cout << " " << keysText(held);
+        cout << endl;
+
+        if (config.savePrefix.empty()) return;
+        string fileName = config.savePrefix + "-" + name + ".input";
+        ofstream script(fileName);
+        if (!script.good()) {
+            cout << "Couldn't create input script " << fileName << "!" << endl;
+            return;
+        }
+        for (size_t step = 0; step < inputs.size(); ++step) script << step * config.stepFrames << " " << keysText(inputs[step]) << "\n";
+        cout << "  replay: chip8emu --headless " << config.romPath << " --input=" << fileName << " --frames=" << inputs.size() * config.stepFrames
+             << " --speed=" << config.options.speed << " --seed=" << config.options.seed << " --romdb=" << endl;
+    }
+
+    bool parseNumber(const string& text, int64_t& value) {
+        try {
+            size_t parsed = 0;
+            value = stoll(text, &parsed, 0);        // 0x prefix for hex addresses
+            return parsed == text.size();
+        }
+        catch (const logic_error&) {
+            return false;
+        }
+    }
+
+    bool parseArguments(int argc, char** argv, settings& config) {
+        string keys = "0123456789ABCDEF";
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            size_t equals = arg.find('=');
+            string name = arg.substr(0, equals);
+            string text = (equals == string::npos) ? "" : arg.substr(equals + 1);
+            int64_t value = 0;
+            bool numeric = parseNumber(text, value);
+
+            if (arg[0] != '-') {
+                if (!config.romPath.empty()) return false;
+                config.romPath = arg;
+            }
+            else if (name == "--depth" && numeric && value > 0) config.depth = static_cast<int>(value);
+            else if (name == "--step" && numeric && value > 0) config.stepFrames = static_cast<int>(value);
+            else if (name == "--width" && numeric && value > 0) config.width = static_cast<size_t>(value);
+            else if (name == "--speed" && numeric && value > 0) config.options.speed = static_cast<int>(value);
+            else if (name == "--threads" && numeric && value >= 0) config.options.threads = static_cast<int>(value);
+            else if (name == "--seed" && numeric && value >= 0) config.options.seed = static_cast<uint32_t>(value);
+            else if (name == "--goal" && numeric && value >= 0) config.goal = value;
+            else if (name == "--keys" && !text.empty()) keys = text;
+            else if (name == "--save" && !text.empty()) config.savePrefix = text;
+            else if (name == "--no-fusion") config.options.enableFusion = false;
+            else if (arg == "--platform=chip8") config.options.platform = ch8Platform::CHIP8;
+            else if (arg == "--platform=schip") config.options.platform = ch8Platform::SCHIP;
+            else if (arg == "--platform=xochip") config.options.platform = ch8Platform::XOCHIP;
+            else if (name == "--score") {
+                size_t colon = text.find(':');
+                int64_t address = 0, bytes = 1;
+                if (!parseNumber(text.substr(0, colon), address) || address < 0 || address >= MEMORY_SIZE) return false;
+                if (colon != string::npos && (!parseNumber(text.substr(colon + 1), bytes) || bytes < 1 || bytes > 4)) return false;
+                config.scoreAddress = static_cast<int>(address);
+                config.scoreBytes = static_cast<int>(bytes);
+            }
+            else return false;
+        }
+
+        // no key and every given key alone
+        config.actions.push_back(0);
+        for (char key : keys) {
+            if (!isxdigit(static_cast<unsigned char>(key))) return false;
+            uint16_t held = 1 << stoi(string(1, key), nullptr, 16);
+            if (find(config.actions.begin(), config.actions.end(), held) == config.actions.end()) config.actions.push_back(held);
+        }
+        return !config.romPath.empty();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    settings config;
+    if (!parseArguments(argc, argv, config)) {
+        cout << "Usage: ch8search romfile [--depth=N] [--step=N] [--width=N] [--keys=hexdigits] [--score=address[:bytes]] [--goal=N]" << endl;
+        cout << "       [--save=prefix] [--speed=N] [--seed=N] [--threads=N] [--platform=chip8|schip|xochip] [--no-fusion]" << endl;
+        cout << "(tries no key and every key alone for --step frames (default 4) from every state, --depth times (default 30)," << endl;
+        cout << " keeps --width new states per depth (default 10000), --score reads a big endian number (1 to 4 bytes) from memory)" << endl;
+        return 1;
+    }
+
+    vector<node> layer(1);
+    vector<vector<pathStep>> history(1, vector<pathStep>(1));
+    stateSet seen;
+    try {
+        chip8 loader(config.options);
+        loader.loadROM(config.romPath);
+        loader.seedRandom(config.options.seed);
+        loader.saveFork(layer[0].state);
+        layer[0].hash = loader.hashState();
+        seen.insert(layer[0].hash);
+    }
+    catch (const runtime_error& e) {
+        cout << e.what() << endl;
+        return 1;
+    }
+
+    ch8CorePool cores;
+    ch8WorkPool pool(config.options.threads);
+    finding fault, stuck, best;
+    uint64_t expanded = 0;
+    auto start = chrono::steady_clock::now();
+
+    cout << "Searching " << config.romPath << " with " << config.actions.size() << " actions on " << pool.size() << " threads" << endl;
+    for (int depth = 0; depth < config.depth && !layer.empty(); ++depth) {
+        // chunks are merged in order and only the merge adds to seen, so which states are kept (and reported first) doesn't depend on the threads
+        vector<chunkResult> results((layer.size() + NODES_PER_TASK - 1) / NODES_PER_TASK);
+        for (size_t c = 0; c < results.size(); ++c) {
+            pool.submit([&, c, depth] {
+                expand(config, cores, layer, c * NODES_PER_TASK, min(layer.size(), (c + 1) * NODES_PER_TASK), depth, seen, results[c]);
+            });
+        }
+        pool.wait();
+
+        vector<node> next;
+        vector<pathStep> links;
+        size_t dropped = 0;
+        for (chunkResult& result : results) {
+            fault.add(result.fault);
+            stuck.add(result.stuck);
+            if (result.best.score > best.score) best = result.best;
+            expanded += result.expanded;
+
+            for (node& n : result.nodes) {
+                if (!seen.insert(n.hash)) continue;     // an earlier chunk reached it too
+                if (next.size() >= config.width) {
+                    ++dropped;
+                    continue;
+                }
+                links.push_back({ n.parent, n.action });
+                next.push_back(std::move(n));
+            }
+        }
+
+        history.push_back(std::move(links));
+        layer = std::move(next);
+        cout << "depth " << depth + 1 << ": " << layer.size() << " new states" << (dropped ? " (" + to_string(dropped) + " dropped)" : "")
+             << ", " << seen.size() << " seen" << endl;
+
+        if (config.goal >= 0 && best.score >= config.goal) break;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << expanded << " states emulated in " << seconds << " s (" << static_cast<uint64_t>(expanded / max(seconds, 1e-9)) << " per second)" << endl;
+
+    report("fault", fault, history, config, true);
+    report("stuck", stuck, history, config, false);
+    if (config.scoreAddress >= 0) report("best", best, history, config, true);
+
+    return fault.found ? 2 : 0;
+}
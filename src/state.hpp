@@ -0,0 +1,46 @@
+#pragma once
+
+#include "memory.hpp"
+#include "framebuffer.hpp"
+#include "fault.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+constexpr int STACK_SIZE = 16;
+constexpr int VREGS_COUNT = 16;			// number of Vx registers
+constexpr int KEYPAD_KEYS = 16;
+constexpr int DISPLAY_LAST_COUNT = 3;	// number of displayed instructions on screen
+
+constexpr int AUDIO_PATTERN_BYTES = 16;		// XO-CHIP audio pattern - 128 one-bit samples
+constexpr uint8_t DEFAULT_PITCH = 64;		// XO-CHIP pitch register value for playing the pattern at 4000 samples per second
+
+constexpr int STANDARD_FPS = 60;		// timers are lowered (and frames shown) 60 times per second
+
+// copy of everything the display shows - published by the emulation thread after every frame
+struct ch8Snapshot {
+	ch8FrameBuffer frameBuffer;
+
+	uint16_t regPC = 0;
+	uint16_t regI = 0;
+	std::array<uint8_t, VREGS_COUNT> regsVx{};
+	uint8_t regDT = 0;
+	uint8_t regST = 0;
+	uint8_t regSP = 0;
+	std::array<uint16_t, STACK_SIZE> stack{};
+	ch8Fault fault = ch8Fault::NONE;		// shown over the screen once the core stopped
+	uint16_t faultPC = 0;
+
+	// last few instructions and their explanations (only filled with explanations enabled)
+	std::vector<std::string> explanations = std::vector<std::string>(DISPLAY_LAST_COUNT);
+	std::array<uint16_t, DISPLAY_LAST_COUNT> lastInstructions{};
+
+	heatArray executeHeat{};
+	heatArray writeHeat{};
+	uint8_t heatShift = 0;		// addresses per heatmap cell = 2^heatShift
+
+	uint32_t frame = 0;		// number of emulated frames
+	uint32_t inputSequence = 0;		// newest keypad press (numbered by the frontend) the emulator has seen before this frame
+};
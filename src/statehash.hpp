@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+// hashes of whole core states (see chip8::hashState) - meant for telling states apart, not for storing on disk
+
+// adds a whole 64-bit word to a hash - one multiply per word instead of eight (FNV-1a), the shift mixes high bits down
+inline uint64_t hashWord(uint64_t value, uint64_t word) {
+	value = (value ^ word) * 0x9E3779B97F4A7C15;
+	return value ^ (value >> 32);
+}
+
+// Zobrist-like key of a value at some position - a hash is the XOR of the keys of all positions, so changing one position
+// is two XORs (old key out, new key in) instead of hashing everything again, zero values have no key (cleared = hash 0)
+// keys are computed (splitmix64 finalizer) instead of stored, a table for every byte value of 64kB would be 128MB
+inline uint64_t zobristKey(uint64_t position, uint64_t value) {
+	if (value == 0) return 0;
+	uint64_t key = value ^ ((position + 1) * 0x9E3779B97F4A7C15);
+	key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9;
+	key = (key ^ (key >> 27)) * 0x94D049BB133111EB;
+	return key ^ (key >> 31);
+}
@@ -0,0 +1,52 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+ch8TraceWriter::ch8TraceWriter(const string& fileName)
+	: file(fileName, ios::binary), buffer(make_unique<ch8TraceRecord[]>(TRACE_BUFFER_RECORDS))
+{
+	if (!file.good()) throw runtime_error("Couldn't create trace file!");
+
+	ch8TraceHeader header;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	writerThread = thread(&ch8TraceWriter::writerLoop, this);
+}
+
+// writes the rest of the records and closes the file
+ch8TraceWriter::~ch8TraceWriter() {
+	running.store(false, memory_order_release);
+	writerThread.join();
+
+	if (fullWaits != 0) cout << "Trace buffer was full " << fullWaits << " times (emulation waited for the disk)." << endl;
+}
+
+void ch8TraceWriter::writerLoop() {
+	while (running.load(memory_order_acquire)) {
+		if (flushAvailable() == 0) this_thread::sleep_for(chrono::milliseconds(1));	// nothing to do -> don't spin
+	}
+
+	flushAvailable();		// records added before stopping
+	file.flush();
+}
+
+size_t ch8TraceWriter::flushAvailable() {
+	uint64_t start = readPos.load(memory_order_relaxed);
+	uint64_t end = writePos.load(memory_order_acquire);
+
+	// available records can wrap around the end of the buffer -> at most two writes
+	for (uint64_t pos = start; pos < end; ) {
+		size_t index = pos & (TRACE_BUFFER_RECORDS - 1);
+		size_t count = min<uint64_t>(end - pos, TRACE_BUFFER_RECORDS - index);
+		file.write(reinterpret_cast<const char*>(&buffer[index]), count * sizeof(ch8TraceRecord));
+
+		pos += count;
+		readPos.store(pos, memory_order_release);		// space can be reused by the emulator
+	}
+
+	return end - start;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+constexpr uint32_t TRACE_MAGIC = 0x52543843;		// "C8TR" in little endian
+constexpr uint16_t TRACE_VERSION = 1;
+constexpr size_t TRACE_BUFFER_RECORDS = 1 << 18;	// ring buffer capacity (8 MB), must be a power of two
+
+// state after one executed instruction - fixed size, written to the trace file as is
+struct ch8TraceRecord {
+	uint32_t frame;					// frame in which the instruction was executed
+	uint16_t regPC;					// address of the instruction
+	uint16_t instruction;
+	uint16_t regI;
+	uint16_t changedRegs;			// bit n set -> Vn was changed by the instruction
+	std::array<uint8_t, 16> regsVx;	// V0 - VF after the instruction
+	uint8_t regDT;
+	uint8_t regST;
+	uint8_t regSP;
+	uint8_t reserved = 0;
+};
+static_assert(sizeof(ch8TraceRecord) == 32, "trace records are stored in files, their size must not change");
+
+// start of every trace file
+struct ch8TraceHeader {
+	uint32_t magic = TRACE_MAGIC;
+	uint16_t version = TRACE_VERSION;
+	uint16_t recordSize = sizeof(ch8TraceRecord);
+};
+
+// collects trace records from the emulation thread in a lock-free ring buffer (single producer, single consumer),
+// a background thread writes them to the file, so the emulation never waits for file I/O
+class ch8TraceWriter {
+private:
+	std::ofstream file;
+	std::unique_ptr<ch8TraceRecord[]> buffer;
+
+	// positions only ever increase, index into buffer is position % TRACE_BUFFER_RECORDS
+	alignas(64) std::atomic<uint64_t> writePos{ 0 };	// next record to be filled by the emulator
+	alignas(64) std::atomic<uint64_t> readPos{ 0 };		// next record to be written to the file
+	alignas(64) std::atomic<bool> running{ true };
+	uint64_t fullWaits = 0;			// how many times the emulator had to wait for the writer (buffer was full)
+
+	std::thread writerThread;
+	void writerLoop();
+	size_t flushAvailable();		// writes everything currently in the buffer to the file, returns number of records
+
+public:
+	explicit ch8TraceWriter(const std::string& fileName);
+	~ch8TraceWriter();
+
+	ch8TraceWriter(const ch8TraceWriter&) = delete;
+	ch8TraceWriter& operator=(const ch8TraceWriter&) = delete;
+
+	// called by the emulator after every instruction
+	void record(const ch8TraceRecord& rec) {
+		uint64_t pos = writePos.load(std::memory_order_relaxed);
+		if (pos - readPos.load(std::memory_order_acquire) == TRACE_BUFFER_RECORDS) {
+			++fullWaits;
+			while (pos - readPos.load(std::memory_order_acquire) == TRACE_BUFFER_RECORDS) std::this_thread::yield();
+		}
+
+		buffer[pos & (TRACE_BUFFER_RECORDS - 1)] = rec;
+		writePos.store(pos + 1, std::memory_order_release);
+	}
+};
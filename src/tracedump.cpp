@@ -0,0 +1,68 @@
+#include "trace.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+using namespace std;
+
+// converts a binary trace written with --trace=file to text (one executed instruction per line)
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        cout << "Usage: ch8trace tracefile [outputfile]" << endl;
+        cout << "(prints to console when no output file is provided)" << endl;
+        return 1;
+    }
+
+    ifstream file(argv[1], ios::binary);
+    if (!file.good()) {
+        cout << "Couldn't open trace file!" << endl;
+        return 1;
+    }
+
+    ch8TraceHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file.good() || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION || header.recordSize != sizeof(ch8TraceRecord)) {
+        cout << "Not a supported trace file!" << endl;
+        return 1;
+    }
+
+    ofstream outFile;
+    if (argc >= 3) {
+        outFile.open(argv[2]);
+        if (!outFile.good()) {
+            cout << "Couldn't create output file!" << endl;
+            return 1;
+        }
+    }
+    ostream& out = (argc >= 3) ? outFile : cout;
+
+    // read in large chunks, traces of long sessions have hundreds of millions of records
+    vector<ch8TraceRecord> records(4096);
+    out << hex << uppercase << setfill('0');
+    while (file) {
+        file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(ch8TraceRecord));
+        size_t count = file.gcount() / sizeof(ch8TraceRecord);
+
+        for (size_t r = 0; r < count; ++r) {
+            const ch8TraceRecord& rec = records[r];
+            out << dec << setfill(' ') << setw(8) << rec.frame << hex << setfill('0')
+                << "  " << setw(3) << rec.regPC << ": " << setw(4) << rec.instruction
+                << "  I=" << setw(3) << rec.regI
+                << " DT=" << setw(2) << static_cast<int>(rec.regDT)
+                << " ST=" << setw(2) << static_cast<int>(rec.regST)
+                << " SP=" << static_cast<int>(rec.regSP);
+
+            // only registers changed by the instruction
+            for (int i = 0; i < 16; ++i) {
+                if (rec.changedRegs & (1 << i)) out << "  V" << i << "=" << setw(2) << static_cast<int>(rec.regsVx[i]);
+            }
+            out << '\n';
+        }
+    }
+    out << flush;
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// lock-free triple buffer - one thread writes complete values, another thread always reads the newest complete one
+// neither of them ever waits: the writer owns one slot, the reader owns one slot and the third one is swapped between them
+template <typename T>
+class ch8TripleBuffer {
+private:
+	static constexpr uint8_t INDEX_MASK = 0x03;
+	static constexpr uint8_t FRESH_BIT = 0x04;		// set when the shared slot contains a value the reader hasn't seen yet
+
+	std::array<T, 3> slots{};
+	alignas(64) std::atomic<uint8_t> shared{ 1 };	// index of the slot in the middle (+ FRESH_BIT)
+	alignas(64) uint8_t writeIndex = 0;				// only used by the writer
+	alignas(64) uint8_t readIndex = 2;				// only used by the reader
+
+public:
+	// writer: fill this slot completely, then publish it (it contains an old value, not the last published one)
+	T& writeBuffer() { return slots[writeIndex]; }
+	void publish() {
+		writeIndex = shared.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// reader: takes the newest published value if there is one, returns false if nothing new was published
+	bool update() {
+		if ((shared.load(std::memory_order_relaxed) & FRESH_BIT) == 0) return false;
+		readIndex = shared.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+	const T& readBuffer() const { return slots[readIndex]; }
+};
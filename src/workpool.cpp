@@ -0,0 +1,95 @@
+#include "workpool.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+ch8WorkPool::ch8WorkPool(unsigned threadCount) {
+	if (threadCount == 0) threadCount = max(1u, thread::hardware_concurrency());
+
+	for (unsigned i = 0; i < threadCount; ++i) queues.push_back(make_unique<taskQueue>());
+	for (unsigned i = 0; i < threadCount; ++i) threads.emplace_back(&ch8WorkPool::workerLoop, this, i);
+}
+
+// tasks submitted before destruction still run
+ch8WorkPool::~ch8WorkPool() {
+	{
+		lock_guard<mutex> guard(stateLock);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (thread& worker : threads) worker.join();
+}
+
+void ch8WorkPool::submit(function<void()> task) {
+	taskQueue& target = *queues[nextQueue];
+	nextQueue = (nextQueue + 1) % queues.size();
+
+	unfinished.fetch_add(1);
+	queued.fetch_add(1);
+	{
+		lock_guard<mutex> guard(target.lock);
+		target.tasks.push_back(std::move(task));
+	}
+
+	// taking the lock first -> a worker can't miss the notification between checking queued and going to sleep
+	{ lock_guard<mutex> guard(stateLock); }
+	workAvailable.notify_one();
+}
+
+void ch8WorkPool::wait() {
+	unique_lock<mutex> guard(stateLock);
+	allDone.wait(guard, [this] { return unfinished.load() == 0; });
+
+	if (taskError) {
+		exception_ptr error = taskError;
+		taskError = nullptr;
+		rethrow_exception(error);
+	}
+}
+
+// newest task of its own queue (still warm in cache), otherwise the oldest task of another queue
+bool ch8WorkPool::takeTask(size_t self, function<void()>& task) {
+	for (size_t i = 0; i < queues.size(); ++i) {
+		taskQueue& source = *queues[(self + i) % queues.size()];
+		lock_guard<mutex> guard(source.lock);
+		if (source.tasks.empty()) continue;
+
+		if (i == 0) {
+			task = std::move(source.tasks.back());
+			source.tasks.pop_back();
+		}
+		else {
+			task = std::move(source.tasks.front());
+			source.tasks.pop_front();
+		}
+		queued.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+void ch8WorkPool::workerLoop(size_t self) {
+	while (true) {
+		function<void()> task;
+		if (takeTask(self, task)) {
+			try {
+				task();
+			}
+			catch (...) {
+				lock_guard<mutex> guard(stateLock);
+				if (!taskError) taskError = current_exception();
+			}
+
+			if (unfinished.fetch_sub(1) == 1) {
+				lock_guard<mutex> guard(stateLock);
+				allDone.notify_all();
+			}
+			continue;
+		}
+
+		unique_lock<mutex> guard(stateLock);
+		workAvailable.wait(guard, [this] { return stopping || queued.load() > 0; });
+		if (stopping && queued.load() == 0) return;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// runs tasks on a fixed set of threads (headless runs, batched environments)
+// every thread has its own queue and takes tasks from the others when it runs out (work stealing),
+// so long and short tasks even out without a single shared queue every thread would fight over
+class ch8WorkPool {
+private:
+	struct taskQueue {
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	};
+	std::vector<std::unique_ptr<taskQueue>> queues;
+	std::vector<std::thread> threads;
+	size_t nextQueue = 0;		// new tasks are spread round robin
+
+	std::atomic<size_t> queued{ 0 };		// submitted and not taken yet
+	std::atomic<size_t> unfinished{ 0 };	// submitted and not finished yet
+	std::mutex stateLock;					// only for sleeping and the fields below
+	std::condition_variable workAvailable;
+	std::condition_variable allDone;
+	bool stopping = false;
+	std::exception_ptr taskError;			// first exception thrown by a task, rethrown by wait()
+
+	bool takeTask(size_t self, std::function<void()>& task);
+	void workerLoop(size_t self);
+
+public:
+	explicit ch8WorkPool(unsigned threadCount = 0);		// 0 = one thread per hardware thread
+	~ch8WorkPool();
+
+	// both are meant to be called by one (owning) thread
+	void submit(std::function<void()> task);
+	void wait();		// returns once every submitted task has finished
+
+	size_t size() const { return threads.size(); }
+};